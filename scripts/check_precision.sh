@@ -0,0 +1,59 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Regression check of the float32 build against the double one:
+# same dataset, same seed, final log-likelihoods must agree within a
+# relative tolerance, and the float32 build must converge within
+# iter_slack iterations of the double one (a float32 run that stops only
+# at the iteration cap is slower than the double build it should beat).
+# Usage: scripts/check_precision.sh [dataset] [num_clusters] [variant: seq|omp] [tolerance] [iter_slack]
+# (SEED=<n> in the environment picks another seed than 42)
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="${ROOT_DIR}/build"
+
+DATASET="${1:-${ROOT_DIR}/datasets/gmm_P10000_K3_D2.csv}"
+K="${2:-3}"
+VARIANT="${3:-seq}"
+TOL="${4:-1e-5}"
+ITER_SLACK="${5:-2}"
+SEED="${SEED:-42}"
+
+cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}" > /dev/null
+cmake --build "${BUILD_DIR}" --target "em_clustering_${VARIANT}" "em_clustering_${VARIANT}_f32" > /dev/null
+
+# "<final log-likelihood> <iterations>", iterations 0 if the run hit the cap
+run_em() {
+    "$1" -d "${DATASET}" -k "${K}" -o /dev/null --seed "${SEED}" \
+        | awk '/Convergence reached at iteration/ { it = $NF + 0 }
+               /Final log-likelihood/ { ll = $NF }
+               END { print ll, it + 0 }'
+}
+
+read -r LL_DOUBLE IT_DOUBLE <<< "$(run_em "${BUILD_DIR}/em_clustering_${VARIANT}")"
+read -r LL_FLOAT IT_FLOAT <<< "$(run_em "${BUILD_DIR}/em_clustering_${VARIANT}_f32")"
+
+describe() {
+    if [ "$2" -eq 0 ]; then echo "$1 (no convergence)"; else echo "$1 (converged at iteration $2)"; fi
+}
+echo "double:  $(describe "${LL_DOUBLE}" "${IT_DOUBLE}")"
+echo "float32: $(describe "${LL_FLOAT}" "${IT_FLOAT}")"
+
+STATUS=0
+awk -v a="${LL_DOUBLE}" -v b="${LL_FLOAT}" -v tol="${TOL}" 'BEGIN {
+    d = a - b; if (d < 0) d = -d
+    m = (a < 0) ? -a : a
+    rel = d / (m + 1e-30)
+    printf "relative difference: %.3e (tolerance %s)\n", rel, tol
+    exit (rel <= tol) ? 0 : 1
+}' || STATUS=1
+
+if [ "${IT_FLOAT}" -eq 0 ] && [ "${IT_DOUBLE}" -ne 0 ]; then
+    echo "float32 build did not converge (double: ${IT_DOUBLE} iterations)"
+    STATUS=1
+elif [ "${IT_DOUBLE}" -ne 0 ] && [ "${IT_FLOAT}" -gt $((IT_DOUBLE + ITER_SLACK)) ]; then
+    echo "float32 build needs ${IT_FLOAT} iterations, double ${IT_DOUBLE} (slack ${ITER_SLACK})"
+    STATUS=1
+fi
+
+[ "${STATUS}" -eq 0 ] && echo "PASS" || { echo "FAIL"; exit 1; }
@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "include/commons.h"
+#include "include/utils.h"
+#include "include/dataset.h"
+
+/* -------------------------------------------------------------
+   CSV loader: the file is memory-mapped and split into chunks at
+   line boundaries. A first parallel scan counts the rows of every
+   chunk (memchr only), so each chunk knows where its rows go in the
+   output array and which line of the file it starts at; a second
+   parallel pass parses the numbers straight into place.
+
+   Every row must have as many fields as the header. The columns up
+   to the first one named "label" are the coordinates; the label column
+   is read too when the caller asks for it, the others are skipped.
+   Blank lines are ignored. Malformed rows are reported with their
+   line number and the load fails.
+
+   load_csv_part() loads only one of 'num_parts' byte ranges of the
+   body, equal or proportional to 'weights' (each rank of the MPI build
+   reads its own); a row belongs to the range its first byte falls in.
+------------------------------------------------------------- */
+
+#define CSV_CHUNKS_PER_THREAD 4
+#define CSV_MIN_CHUNK_BYTES (1 << 16)
+#define CSV_MAX_REPORTED 10 // Malformed rows printed, the rest are only counted
+
+typedef struct {
+    size_t line;
+    char msg[96];
+} CsvError;
+
+typedef struct {
+    const char *begin, *end;
+    size_t num_lines;  // All lines, blank ones included
+    size_t num_rows;   // Data rows
+    size_t first_line; // Line number of 'begin' in the file (1-based)
+    size_t first_row;  // Index of the chunk's first row in the dataset
+    size_t num_errors;
+    CsvError errors[CSV_MAX_REPORTED];
+} CsvChunk;
+
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int is_blank_line(const char *p, const char *eol) {
+    for (; p < eol; p++)
+        if (!is_space(*p)) return 0;
+    return 1;
+}
+
+static const char* skip_spaces(const char *p, const char *eol) {
+    while (p < eol && is_space(*p)) p++;
+    return p;
+}
+
+// strtod on a bounded copy: the mapping is not NUL terminated
+static const char* parse_double_slow(const char *p, const char *eol, double *out) {
+    char buf[64];
+    size_t len = 0;
+    while (p + len < eol && p[len] != ',' && !is_space(p[len]) && len < sizeof(buf) - 1) {
+        buf[len] = p[len];
+        len++;
+    }
+    buf[len] = '\0';
+
+    char *stop;
+    *out = strtod(buf, &stop);
+    if (len == 0 || stop != buf + len) return NULL;
+    return p + len;
+}
+
+// Decimal number [+-]digits[.digits][(e|E)[+-]digits]. Exact when the
+// mantissa fits in 53 bits and |exponent| <= 22 (one correctly rounded
+// multiplication or division), anything else goes through strtod.
+static const char* parse_double(const char *p, const char *eol, double *out) {
+    const char *start = p;
+    int negative = 0;
+    if (p < eol && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int num_digits = 0, exp10 = 0;
+    while (p < eol && (unsigned)(*p - '0') < 10) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        num_digits++;
+        p++;
+    }
+    if (p < eol && *p == '.') {
+        p++;
+        while (p < eol && (unsigned)(*p - '0') < 10) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            num_digits++;
+            exp10--;
+            p++;
+        }
+    }
+    if (num_digits == 0)
+        return parse_double_slow(start, eol, out); // nan, inf or garbage
+
+    if (p < eol && (*p == 'e' || *p == 'E')) {
+        p++;
+        int exp_negative = 0, exp_value = 0, exp_digits = 0;
+        if (p < eol && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            p++;
+        }
+        while (p < eol && (unsigned)(*p - '0') < 10) {
+            if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+            exp_digits++;
+            p++;
+        }
+        if (exp_digits == 0) return NULL;
+        exp10 += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (num_digits > 19 || mantissa > (1ULL << 53) || exp10 < -22 || exp10 > 22)
+        return parse_double_slow(start, eol, out);
+
+    double value = (double)mantissa;
+    value = (exp10 < 0) ? value / pow10_table[-exp10] : value * pow10_table[exp10];
+    *out = negative ? -value : value;
+    return p;
+}
+
+// One data row into 'row' (dim values) and, if not NULL, its label into
+// 'label'. 0 on success or -1 with 'msg' set
+static int parse_row(const char *p, const char *eol, int dim, int num_fields, T *row, int *label,
+                     char *msg, size_t msg_size) {
+    for (int f = 0; f < num_fields; f++) {
+        p = skip_spaces(p, eol);
+        if (f < dim || (f == dim && label)) {
+            double value;
+            const char *next = parse_double(p, eol, &value);
+            // labels are integers within int range (the cast is undefined outside it)
+            if (!next || (f == dim && !(value >= INT_MIN && value <= INT_MAX && value == floor(value)))) {
+                const char *field_end = p;
+                while (field_end < eol && *field_end != ',') field_end++;
+                snprintf(msg, msg_size, "invalid number '%.*s' in column %d",
+                         (int)(field_end - p < 32 ? field_end - p : 32), p, f + 1);
+                return -1;
+            }
+            if (f < dim)
+                row[f] = (T)value;
+            else
+                *label = (int)value;
+            p = skip_spaces(next, eol);
+        } else {
+            while (p < eol && *p != ',') p++; // columns after the coordinates (label)
+        }
+
+        if (f < num_fields - 1) {
+            if (p >= eol || *p != ',') {
+                snprintf(msg, msg_size, "expected %d fields, found %d", num_fields, f + 1);
+                return -1;
+            }
+            p++;
+        }
+    }
+    if (p < eol) {
+        int extra = 0;
+        for (; p < eol; p++) extra += (*p == ',');
+        snprintf(msg, msg_size, "expected %d fields, found %d", num_fields, num_fields + extra);
+        return -1;
+    }
+    return 0;
+}
+
+// Header: number of fields and index of the "label" column (or num_fields)
+static void parse_header(const char *p, const char *eol, int *num_fields, int *dim) {
+    *num_fields = 0;
+    *dim = -1;
+    while (p <= eol) {
+        const char *field_end = p;
+        while (field_end < eol && *field_end != ',') field_end++;
+
+        // names may be quoted (R's write.csv)
+        const char *name = skip_spaces(p, field_end);
+        const char *name_end = field_end;
+        while (name_end > name && is_space(name_end[-1])) name_end--;
+        if (name_end - name >= 2 && *name == '"' && name_end[-1] == '"') {
+            name++;
+            name_end--;
+        }
+        if (*dim < 0 && name_end - name == 5 && strncmp(name, "label", 5) == 0)
+            *dim = *num_fields;
+
+        (*num_fields)++;
+        p = field_end + 1;
+    }
+    if (*dim < 0) *dim = *num_fields;
+}
+
+// First line start at or after 'p'
+static const char* next_line_start(const char *p, const char *body, const char *end) {
+    if (p > body && p < end && p[-1] != '\n') {
+        const char *nl = (const char*)memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    return p;
+}
+
+static void scan_chunk(CsvChunk *chunk) {
+    const char *p = chunk->begin;
+    while (p < chunk->end) {
+        const char *nl = (const char*)memchr(p, '\n', chunk->end - p);
+        const char *eol = nl ? nl : chunk->end;
+        chunk->num_lines++;
+        if (!is_blank_line(p, eol)) chunk->num_rows++;
+        p = eol + 1;
+    }
+}
+
+static void parse_chunk(CsvChunk *chunk, int dim, int num_fields, T *data, int *labels) {
+    const char *p = chunk->begin;
+    size_t line = chunk->first_line;
+    size_t row = chunk->first_row;
+    char msg[sizeof(chunk->errors[0].msg)];
+
+    while (p < chunk->end) {
+        const char *nl = (const char*)memchr(p, '\n', chunk->end - p);
+        const char *eol = nl ? nl : chunk->end;
+        if (!is_blank_line(p, eol)) {
+            int *label = labels ? &labels[row] : NULL;
+            if (parse_row(p, eol, dim, num_fields, &data[row * dim], label, msg, sizeof(msg)) != 0) {
+                if (chunk->num_errors < CSV_MAX_REPORTED) {
+                    CsvError *err = &chunk->errors[chunk->num_errors];
+                    err->line = line;
+                    memcpy(err->msg, msg, sizeof(msg));
+                }
+                chunk->num_errors++;
+            }
+            row++;
+        }
+        line++;
+        p = eol + 1;
+    }
+}
+
+// 'labels' (may be NULL) receives the label column, or NULL if the file has none
+T* load_csv(const char* filename, int* num_rows, int* num_cols, int** labels) {
+    return load_csv_part(filename, NULL, 0, 1, num_rows, num_cols, labels);
+}
+
+T* load_csv_part(const char* filename, const int* weights, int part, int num_parts,
+                 int* num_rows, int* num_cols, int** labels) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror(filename);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable file\n", filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *map = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    const char *end = map + size;
+
+    /* ---- 1. Header ---- */
+    const char *header_end = (const char*)memchr(map, '\n', size);
+    if (!header_end) header_end = end;
+    int num_fields, dim;
+    parse_header(map, header_end, &num_fields, &dim);
+    T *data = NULL;
+    int *label_data = NULL;
+    CsvChunk *chunks = NULL;
+    if (labels) *labels = NULL;
+    if (dim == 0) {
+        fprintf(stderr, "%s:1: no coordinate columns in the header\n", filename);
+        goto done;
+    }
+
+    /* ---- 2. Chunks at line boundaries ---- */
+    const char *body = (header_end < end) ? header_end + 1 : end;
+    long long range_begin, range_end;
+    partition_range(end - body, weights, part, num_parts, &range_begin, &range_end);
+    const char *part_begin = next_line_start(body + range_begin, body, end);
+    const char *part_end = next_line_start(body + range_end, body, end);
+    size_t body_size = part_end - part_begin;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t advise_begin = (size_t)(part_begin - map) / page * page;
+    madvise((void*)(map + advise_begin), (size_t)(part_end - map) - advise_begin, MADV_WILLNEED);
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    size_t num_chunks = (size_t)num_threads * CSV_CHUNKS_PER_THREAD;
+    if (num_chunks > body_size / CSV_MIN_CHUNK_BYTES) num_chunks = body_size / CSV_MIN_CHUNK_BYTES;
+    if (num_chunks == 0) num_chunks = 1;
+
+    chunks = (CsvChunk*)calloc(num_chunks, sizeof(CsvChunk));
+    for (size_t c = 0; c < num_chunks; c++) {
+        const char *begin = next_line_start(part_begin + body_size / num_chunks * c, part_begin, part_end);
+        chunks[c].begin = begin;
+        if (c > 0) chunks[c - 1].end = begin;
+    }
+    chunks[num_chunks - 1].end = part_end;
+
+    /* ---- 3. Rows per chunk ---- */
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (size_t c = 0; c < num_chunks; c++)
+        scan_chunk(&chunks[c]);
+
+    size_t N = 0, line = 2;
+    for (size_t c = 0; c < num_chunks; c++) {
+        chunks[c].first_row = N;
+        chunks[c].first_line = line;
+        N += chunks[c].num_rows;
+        line += chunks[c].num_lines;
+    }
+    // a part without a whole row (small file, many parts) is a valid empty
+    // share, only the whole file must have rows
+    if (N == 0 && num_parts == 1) {
+        fprintf(stderr, "%s: no data rows\n", filename);
+        goto done;
+    }
+    if (N * dim > INT_MAX) {
+        fprintf(stderr, "%s: %zu rows x %d columns is too large\n", filename, N, dim);
+        goto done;
+    }
+
+    /* ---- 4. Parse ---- */
+    data = (T*)malloc((N * dim + 1) * sizeof(T));
+    if (labels && dim < num_fields)
+        label_data = (int*)malloc((N + 1) * sizeof(int));
+    if (!data || (labels && dim < num_fields && !label_data)) {
+        perror("malloc");
+        goto done;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (size_t c = 0; c < num_chunks; c++)
+        parse_chunk(&chunks[c], dim, num_fields, data, label_data);
+
+    /* ---- 5. Malformed rows, in file order ---- */
+    size_t num_errors = 0;
+    for (size_t c = 0; c < num_chunks; c++)
+        num_errors += chunks[c].num_errors;
+    if (num_errors > 0) {
+        // lines before the part are only counted when there is something to report
+        size_t lines_before = 0;
+        for (const char *p = body; p < part_begin; p++) {
+            p = (const char*)memchr(p, '\n', part_begin - p);
+            if (!p) break;
+            lines_before++;
+        }
+        size_t num_reported = 0;
+        for (size_t c = 0; c < num_chunks; c++) {
+            for (size_t e = 0; e < chunks[c].num_errors && e < CSV_MAX_REPORTED && num_reported < CSV_MAX_REPORTED; e++, num_reported++)
+                fprintf(stderr, "%s:%zu: %s\n", filename, lines_before + chunks[c].errors[e].line, chunks[c].errors[e].msg);
+        }
+        if (num_errors > CSV_MAX_REPORTED)
+            fprintf(stderr, "%s: %zu malformed rows in total\n", filename, num_errors);
+        free(data);
+        data = NULL;
+        goto done;
+    }
+
+    *num_rows = (int)N;
+    *num_cols = dim;
+    if (labels) {
+        *labels = label_data;
+        label_data = NULL;
+    }
+
+done:
+    free(label_data);
+    free(chunks);
+    munmap((void*)map, size);
+    return data;
+}
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/commons.h"
+#include "include/dataset.h"
+#include "include/utils.h"
+
+#define T_DTYPE (sizeof(T) == sizeof(float) ? DATASET_FLOAT32 : DATASET_FLOAT64)
+
+static uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24);
+}
+
+static uint64_t swap64(uint64_t v) {
+    return ((uint64_t)swap32((uint32_t)v) << 32) | swap32((uint32_t)(v >> 32));
+}
+
+static size_t dtype_size(uint32_t dtype) {
+    return dtype == DATASET_FLOAT32 ? sizeof(float) : sizeof(double);
+}
+
+// Header of a binary dataset in native byte order, 0 on success or -1
+static int read_header(int fd, const char *path, DatasetHeader *h, int *swapped) {
+    if (pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) || memcmp(h->magic, DATASET_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a binary dataset\n", path);
+        return -1;
+    }
+
+    *swapped = (h->endian_tag != DATASET_ENDIAN_TAG);
+    if (*swapped) {
+        if (swap32(h->endian_tag) != DATASET_ENDIAN_TAG) {
+            fprintf(stderr, "%s: corrupted header (byte order tag)\n", path);
+            return -1;
+        }
+        h->dtype = swap32(h->dtype);
+        h->num_points = swap64(h->num_points);
+        h->dim = swap32(h->dim);
+        h->has_labels = swap32(h->has_labels);
+        h->data_offset = swap64(h->data_offset);
+        h->labels_offset = swap64(h->labels_offset);
+    }
+
+    if (h->dtype != DATASET_FLOAT32 && h->dtype != DATASET_FLOAT64) {
+        fprintf(stderr, "%s: unknown dtype %u\n", path, h->dtype);
+        return -1;
+    }
+    // any N, as long as the file size fits in 64 bits (slices are checked by load_bin)
+    if (h->dim == 0 || h->dim > INT_MAX || h->num_points == 0
+        || h->num_points > (UINT64_MAX - h->data_offset) / h->dim / sizeof(double)) {
+        fprintf(stderr, "%s: unsupported size %llu x %u\n", path,
+                (unsigned long long)h->num_points, h->dim);
+        return -1;
+    }
+
+    struct stat st;
+    uint64_t data_end = h->data_offset + h->num_points * h->dim * dtype_size(h->dtype);
+    uint64_t labels_end = h->has_labels ? h->labels_offset + h->num_points * sizeof(int32_t) : 0;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < data_end || (uint64_t)st.st_size < labels_end) {
+        fprintf(stderr, "%s: truncated file\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int dataset_is_binary(const char *path) {
+    char magic[8];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    int is_binary = fread(magic, 1, 8, fp) == 8 && memcmp(magic, DATASET_MAGIC, 8) == 0;
+    fclose(fp);
+    return is_binary;
+}
+
+// Size of a binary dataset from its header only
+int dataset_info(const char *path, long long *num_points, int *dim) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    DatasetHeader h;
+    int swapped;
+    int ret = read_header(fd, path, &h, &swapped);
+    close(fd);
+    if (ret != 0) return -1;
+
+    if (h.num_points > LLONG_MAX) {
+        fprintf(stderr, "%s: unsupported size %llu x %u\n", path, (unsigned long long)h.num_points, h.dim);
+        return -1;
+    }
+    *num_points = (long long)h.num_points;
+    *dim = (int)h.dim;
+    return 0;
+}
+
+// Points [first_point, first_point + num_points) of a binary dataset. Only
+// the pages of the slice are mapped; they are used in place when the file
+// holds T in native byte order, converted into a heap copy otherwise. The
+// slice, not the file, must fit the int indexing of the EM code.
+static int load_bin(const char *path, long long first_point, long long num_points, int with_labels, Dataset *ds) {
+    memset(ds, 0, sizeof(*ds));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    DatasetHeader h;
+    int swapped;
+    if (read_header(fd, path, &h, &swapped) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (first_point < 0 || num_points <= 0 || (uint64_t)first_point + (uint64_t)num_points > h.num_points) {
+        fprintf(stderr, "%s: points [%lld, %lld) out of range (%llu points)\n", path,
+                first_point, first_point + num_points, (unsigned long long)h.num_points);
+        close(fd);
+        return -1;
+    }
+    if (num_points > INT_MAX / h.dim) {
+        fprintf(stderr, "%s: %lld points of %u dimensions are too many to load at once "
+                "(use --online, or more MPI processes)\n", path, num_points, h.dim);
+        close(fd);
+        return -1;
+    }
+
+    size_t elem_size = dtype_size(h.dtype);
+    size_t num_elems = (size_t)num_points * h.dim;
+    off_t offset = (off_t)(h.data_offset + (uint64_t)first_point * h.dim * elem_size);
+    off_t page = (off_t)sysconf(_SC_PAGESIZE);
+    off_t map_offset = offset / page * page;
+    size_t map_size = (size_t)(offset - map_offset) + num_elems * elem_size;
+
+    // private writable mapping: the EM code takes non-const pointers
+    char *map = (char*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_offset);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+    const char *src = map + (offset - map_offset);
+
+    if (h.dtype == T_DTYPE && !swapped) {
+        ds->data = (T*)src; // zero copy
+        ds->map = map;
+        ds->map_size = map_size;
+    } else {
+        ds->data = (T*)malloc(num_elems * sizeof(T));
+        for (size_t i = 0; i < num_elems; i++) {
+            if (h.dtype == DATASET_FLOAT32) {
+                uint32_t bits;
+                float value;
+                memcpy(&bits, src + i * sizeof(float), sizeof(bits));
+                if (swapped) bits = swap32(bits);
+                memcpy(&value, &bits, sizeof(value));
+                ds->data[i] = (T)value;
+            } else {
+                uint64_t bits;
+                double value;
+                memcpy(&bits, src + i * sizeof(double), sizeof(bits));
+                if (swapped) bits = swap64(bits);
+                memcpy(&value, &bits, sizeof(value));
+                ds->data[i] = (T)value;
+            }
+        }
+        munmap(map, map_size);
+    }
+
+    if (with_labels && h.has_labels) {
+        int32_t *raw = (int32_t*)malloc((size_t)num_points * sizeof(int32_t));
+        off_t labels_offset = (off_t)(h.labels_offset + (uint64_t)first_point * sizeof(int32_t));
+        ssize_t bytes = (ssize_t)((size_t)num_points * sizeof(int32_t));
+        if (pread(fd, raw, bytes, labels_offset) == bytes) {
+            ds->labels = (int*)malloc((size_t)num_points * sizeof(int));
+            for (long long n = 0; n < num_points; n++)
+                ds->labels[n] = (int)(swapped ? (int32_t)swap32((uint32_t)raw[n]) : raw[n]);
+        }
+        free(raw);
+    }
+    close(fd);
+
+    ds->num_points = (int)num_points;
+    ds->dim = (int)h.dim;
+    return 0;
+}
+
+// Whole dataset, binary or CSV (detected from the magic number)
+int load_dataset(const char *path, Dataset *ds) {
+    if (dataset_is_binary(path)) {
+        long long num_points;
+        int dim;
+        if (dataset_info(path, &num_points, &dim) != 0) return -1;
+        return load_bin(path, 0, num_points, 1, ds);
+    }
+
+    memset(ds, 0, sizeof(*ds));
+    ds->data = load_csv(path, &ds->num_points, &ds->dim, &ds->labels);
+    return ds->data ? 0 : -1;
+}
+
+// Slice of a binary dataset (without labels), e.g. the points of one MPI rank
+int load_dataset_rows(const char *path, long long first_point, long long num_points, Dataset *ds) {
+    return load_bin(path, first_point, num_points, 0, ds);
+}
+
+// Items [begin, end) of share 'part' of 'total' items split in 'num_parts'
+// contiguous blocks, proportional to 'weights' (NULL: equal, sizes differ
+// by at most one item)
+void partition_range(long long total, const int *weights, int part, int num_parts, long long *begin, long long *end) {
+    long long weight_before = part, weight_total = num_parts;
+    if (weights) {
+        weight_before = weight_total = 0;
+        for (int p = 0; p < num_parts; p++) {
+            if (p < part) weight_before += weights[p];
+            weight_total += weights[p];
+        }
+    }
+    long long weight_part = weights ? weights[part] : 1;
+    *begin = total * weight_before / weight_total;
+    *end = (part == num_parts - 1) ? total : total * (weight_before + weight_part) / weight_total;
+}
+
+// Share 'part' of 'num_parts' of a dataset (see partition_range), without
+// reading the rest: a block of points of a binary file, a byte range of a CSV.
+// A share may hold no points at all (num_points 0).
+int load_dataset_part(const char *path, const int *weights, int part, int num_parts, Dataset *ds) {
+    if (dataset_is_binary(path)) {
+        long long num_points, first, last;
+        int dim;
+        if (dataset_info(path, &num_points, &dim) != 0) return -1;
+        partition_range(num_points, weights, part, num_parts, &first, &last);
+        if (last == first) {
+            // fewer points than parts: a valid empty share
+            memset(ds, 0, sizeof(*ds));
+            ds->data = (T*)malloc(sizeof(T));
+            ds->dim = dim;
+            return 0;
+        }
+        return load_bin(path, first, last - first, 0, ds);
+    }
+
+    memset(ds, 0, sizeof(*ds));
+    ds->data = load_csv_part(path, weights, part, num_parts, &ds->num_points, &ds->dim, NULL);
+    return ds->data ? 0 : -1;
+}
+
+int write_dataset_bin(const char *path, const T *data, const int *labels, int num_points, int dim) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    DatasetHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DATASET_MAGIC, 8);
+    h.endian_tag = DATASET_ENDIAN_TAG;
+    h.dtype = T_DTYPE;
+    h.num_points = (uint64_t)num_points;
+    h.dim = (uint32_t)dim;
+    h.has_labels = labels != NULL;
+    h.data_offset = DATASET_HEADER_SIZE;
+    h.labels_offset = labels ? DATASET_HEADER_SIZE + (uint64_t)num_points * dim * sizeof(T) : 0;
+
+    size_t num_elems = (size_t)num_points * dim;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(data, sizeof(T), num_elems, fp) == num_elems;
+    for (int n = 0; ok && labels && n < num_points; n++) {
+        int32_t label = (int32_t)labels[n];
+        ok = fwrite(&label, sizeof(label), 1, fp) == 1;
+    }
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void free_dataset(Dataset *ds) {
+    if (ds->map)
+        munmap(ds->map, ds->map_size);
+    else
+        free(ds->data);
+    free(ds->labels);
+    ds->data = NULL;
+    ds->labels = NULL;
+    ds->map = NULL;
+}
+
+#define CSV_SAMPLE_BYTES (1 << 16)
+
+int dataset_chunks_open(const char *path, int chunk_points, DatasetChunks *chunks) {
+    memset(chunks, 0, sizeof(*chunks));
+    if (strlen(path) >= sizeof(chunks->path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    strcpy(chunks->path, path);
+    chunks->chunk_points = chunk_points;
+    chunks->binary = dataset_is_binary(path);
+
+    if (chunks->binary) {
+        long long num_points, num_chunks;
+        int dim;
+        if (dataset_info(path, &num_points, &dim) != 0) return -1;
+        num_chunks = (num_points + chunk_points - 1) / chunk_points;
+        if (num_chunks > INT_MAX) {
+            fprintf(stderr, "%s: %lld points make more than %d chunks of %d\n", path, num_points, INT_MAX, chunk_points);
+            return -1;
+        }
+        chunks->num_points = num_points;
+        chunks->num_chunks = (int)num_chunks;
+        return 0;
+    }
+
+    // CSV: rows per byte from a sample past the header
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    char *sample = (char*)malloc(CSV_SAMPLE_BYTES);
+    size_t bytes = fread(sample, 1, CSV_SAMPLE_BYTES, fp);
+    fseek(fp, 0, SEEK_END);
+    long long file_size = ftell(fp);
+    fclose(fp);
+
+    const char *body = (const char*)memchr(sample, '\n', bytes);
+    size_t body_bytes = 0, rows = 0;
+    if (body) {
+        body++;
+        body_bytes = bytes - (size_t)(body - sample);
+        for (const char *p = body; (p = (const char*)memchr(p, '\n', sample + bytes - p)) != NULL; p++)
+            rows++;
+    }
+    free(sample);
+    if (!body) {
+        fprintf(stderr, "%s: no data rows\n", path);
+        return -1;
+    }
+    if (rows == 0) {
+        // not even one whole row in the sample: a single chunk
+        chunks->num_points = -1;
+        chunks->num_chunks = 1;
+        return 0;
+    }
+
+    double row_bytes = (double)body_bytes / rows;
+    long long num_chunks = (long long)(file_size / (row_bytes * chunk_points)) + 1;
+    chunks->num_points = -1;
+    chunks->num_chunks = num_chunks > INT_MAX ? INT_MAX : (int)num_chunks;
+    return 0;
+}
+
+// Points of chunk 'chunk' (< num_chunks), without labels
+int dataset_chunk_load(const DatasetChunks *chunks, int chunk, Dataset *ds) {
+    if (chunks->binary) {
+        long long first = (long long)chunk * chunks->chunk_points;
+        long long count = chunks->num_points - first < chunks->chunk_points
+                        ? chunks->num_points - first : chunks->chunk_points;
+        return load_bin(chunks->path, first, count, 0, ds);
+    }
+
+    memset(ds, 0, sizeof(*ds));
+    ds->data = load_csv_part(chunks->path, NULL, chunk, chunks->num_chunks, &ds->num_points, &ds->dim, NULL);
+    return ds->data ? 0 : -1;
+}
@@ -4,96 +4,112 @@
 
 #include "include/matrix_utils.h"
 #include "include/commons.h"
+#include "include/scratch.h"
+#include "include/suff_stats.h"
+#include "include/model.h"
 
-// E-step
-void e_step(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T* resp) {
-    // Reset class_resp
-    for(int k = 0; k < num_clusters; k++) {
-        gmm[k].class_resp = 0.0;
-    }
+// E-step: log-space responsibilities, returns the log-likelihood of the current parameters
+double e_step(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, T* resp) {
+    double log_lik = 0.0;
 
-    for(int i = 0; i < num_data_points; i++) { 
-        T norm = 0.0;
-        int row_offset = i * num_clusters; 
-        int data_offset = i * dim;         
-
-        // 1. Calculate unnormalized responsibility
-        for(int k = 0; k < num_clusters; k++) {
-            // Pass pointer of the i-th point &data_points[data_offset]
-            T pdf = multiv_gaussian_pdf(&data_points[data_offset], dim, gmm[k].mean, gmm[k].cov); 
-            resp[row_offset + k] = gmm[k].weight * pdf;
-            norm += resp[row_offset + k];
-        }
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
 
-        // 2. Normalization and accumulation of class_resp
-        for(int k = 0; k < num_clusters; k++) { 
-            resp[row_offset + k] /= (norm + 1e-18); // Protection against division by zero
-            gmm[k].class_resp += resp[row_offset + k];
-        } 
+        // 1. Calculate log(weight * pdf) for a block of points
+        log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, &resp[b * num_clusters]);
+
+        // 2. Log-sum-exp normalization
+        for(int i = b; i < b + count; i++) {
+            log_lik += log_sum_exp_normalize(&resp[i * num_clusters], num_clusters);
+        }
     }
+    return log_lik;
 }
 
-// M-step
-void m_step(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T* resp) {
-    for(int k = 0; k < num_clusters; k++) {
-        // Update weights
-        gmm[k].weight = gmm[k].class_resp / num_data_points;
-
-        // Update means
-        for (int d = 0; d < dim; d++) {
-            gmm[k].mean[d] = 0.0;
-            for (int i = 0; i < num_data_points; i++) {
-                gmm[k].mean[d] += resp[i * num_clusters + k] * data_points[i * dim + d];
-            }
-            gmm[k].mean[d] /= (gmm[k].class_resp + 1e-18);
-        }
+// M-step: one pass over the data accumulates the sufficient statistics of
+// all clusters (in double), then weights, means and covariances
+void m_step(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, T* resp) {
+    Scratch* scratch = thread_scratch();
+    size_t mark = scratch_mark(scratch);
+    SuffStats stats;
+    stats_init_scratch(&stats, num_clusters, dim, scratch);
+    stats_zero(&stats);
 
-        // Update covariance matrices
-        for(int i = 0; i < dim; i++) {
-            for(int j = 0; j < dim; j++) {
-                gmm[k].cov[i][j] = 0.0;
-                for(int n = 0; n < num_data_points; n++) {
-                    T diff_i = data_points[n * dim + i] - gmm[k].mean[i];
-                    T diff_j = data_points[n * dim + j] - gmm[k].mean[j];
-                    gmm[k].cov[i][j] += resp[n * num_clusters + k] * diff_i * diff_j;
-                }
-                gmm[k].cov[i][j] /= (gmm[k].class_resp + 1e-18);
-            }
-        }
+    for(int n = 0; n < num_data_points; n++) {
+        stats_accumulate(&stats, &data_points[n * dim], &resp[n * num_clusters], gmm);
+    }
+
+    // Centered covariances with regularization
+    stats_to_gmm(&stats, gmm, num_data_points);
+    scratch_release(scratch, mark);
+}
 
-        // Regularization
-        for (int i = 0; i < dim; i++)
-            gmm[k].cov[i][i] += 1e-6;
+// Streaming E-step: responsibilities of each block of points go straight
+// into the M-step statistics, returns the log-likelihood of the current parameters
+double e_step_streaming(T* data_points, int dim, int num_data_points, GMM* gmm, SuffStats* stats) {
+    stats_zero(stats);
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+        stats_accumulate_block(stats, &data_points[b * dim], count, gmm);
     }
+    return *stats->log_lik;
 }
 
-void em_algorithm(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, int* labels) {
-    T* resp = (T*)malloc(num_data_points * num_clusters * sizeof(T));
-    T prev_log_likelihood = -INFINITY;
+double em_algorithm(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels, EMOptions* options) {
+    // The streaming mode never materializes the N x K responsibilities
+    T* resp = options->streaming ? NULL : (T*)malloc(num_data_points * num_clusters * sizeof(T));
+    double prev_log_likelihood = options->start_log_lik; // -INFINITY unless resuming
+
+    // E-step kernel buffers (and the streaming statistics) come from the scratch arena
+    scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(dim, num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS)
+                  + SCRATCH_BYTES(STATS_ELEMS(num_clusters, dim), sizeof(double), 1));
+    precompute_gaussians(gmm, num_clusters, dim);
 
-    for(int iter = 0; iter < MAX_ITER; iter++) {
-        e_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
-        m_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+    SuffStats stats;
+    if (options->streaming)
+        stats_init_scratch(&stats, num_clusters, dim, thread_scratch());
 
-        double log_lik = log_likelihood(data_points, dim, num_data_points, gmm, num_clusters);
+    ALLOC_CHECK_DEF()
+    for(int iter = options->start_iter; iter < options->max_iter; iter++) {
+        ALLOC_CHECK_START(iter)
+        // The E-step also yields the log-likelihood of the current parameters
+        double log_lik = options->streaming
+            ? e_step_streaming(data_points, dim, num_data_points, gmm, &stats)
+            : e_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
 
-        if(fabs(log_lik - prev_log_likelihood) < EPSILON) {
+        if(LOG_LIK_CONVERGED(log_lik, prev_log_likelihood, num_data_points)) {
             printf("[DEBUG] Convergence reached at iteration %d.\n", iter + 1);
+            checkpoint_em(options, gmm, iter, prev_log_likelihood, 1);
             break;
         }
         prev_log_likelihood = log_lik;
+
+        if (options->streaming)
+            stats_to_gmm(&stats, gmm, num_data_points);
+        else
+            m_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+        precompute_gaussians(gmm, num_clusters, dim);
+        checkpoint_em(options, gmm, iter + 1, prev_log_likelihood, iter + 1 == MAX_ITER);
     }
+    ALLOC_CHECK_PRINT()
+    printf("[DEBUG] Final log-likelihood: %.6f\n", prev_log_likelihood);
 
     // Assign labels
-    for (int n = 0; n < num_data_points; n++) {
-        int max_k = 0;
-        int offset = n * num_clusters;
-        for (int k = 1; k < num_clusters; k++) {
-            if (resp[offset + k] > resp[offset + max_k])
-                max_k = k;
+    if (options->streaming) {
+        predict_labels(data_points, dim, num_data_points, gmm, num_clusters, labels);
+    } else {
+        for (int n = 0; n < num_data_points; n++) {
+            int max_k = 0;
+            int offset = n * num_clusters;
+            for (int k = 1; k < num_clusters; k++) {
+                if (resp[offset + k] > resp[offset + max_k])
+                    max_k = k;
+            }
+            labels[n] = max_k;
         }
-        labels[n] = max_k;
     }
 
     free(resp);
-}
\ No newline at end of file
+    scratch_teardown();
+    return prev_log_likelihood;
+}
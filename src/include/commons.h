@@ -1,25 +1,138 @@
 #ifndef __COMMONS_H_
 #define __COMMONS_H_
+#include <stddef.h>
+#include <float.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 
 #define MAX_ITER 200
 #define EPSILON 1e-6
 #define PI 3.14159265358979323846
 
+#define POINT_BLOCK 16 // Points evaluated together by the density kernels
+
+// Per-thread scratch needed by log_joint_block, log_multiv_gaussian_pdf and log_likelihood
+#define PDF_SCRATCH_ELEMS(dim, num_clusters) \
+    ((size_t)(dim) * (POINT_BLOCK + 1) + (size_t)POINT_BLOCK * ((num_clusters) + 1))
+#define PDF_SCRATCH_ALLOCS 4
+
 #define DEFAULT_DATASET_PATH "./datasets/gmm_P10000_K3_D2.csv"
 #define DEFAULT_OUTPUT_PATH "./results/em_P10000_K3_D2.csv"
 #define DEFAULT_NUM_CLUSTERS 3
 
-typedef double T; 
+// Storage and kernel precision, -DUSE_FLOAT selects the float32 variants.
+// Sums over the data points (sufficient statistics, log-likelihood) are always double.
+#ifdef USE_FLOAT
+typedef float T;
+#define MPI_T MPI_FLOAT
+#define T_EPSILON FLT_EPSILON
+#else
+typedef double T;
+#define MPI_T MPI_DOUBLE
+#define T_EPSILON DBL_EPSILON
+#endif
+
+// EM convergence over N points: the log-likelihood changed by less than
+// EPSILON, or by less than the rounding of T in the per-point densities,
+// about N * T_EPSILON. Float32 kernels move a log-likelihood of 1e5-1e6 by
+// 1e-4-1e-3 from one iteration to the next (even cycling between two
+// values), so the absolute test alone never stops them. The double builds
+// only see the second term beyond N ~ 4e9.
+#define LOG_LIK_CONVERGED(log_lik, prev, N) \
+    (fabs((log_lik) - (prev)) < fmax(EPSILON, (double)(N) * T_EPSILON))
+
+#define AFFINITY_REPORT 1
+#define AFFINITY_PIN 2
+
+// Run-time options of the EM algorithm, set from the command line
+typedef struct {
+    int streaming;          // Fold the E-step into the M-step statistics, no N x K responsibility matrix
+    unsigned int seed;      // Seed of the random initialization
+    int init_method;        // --init: INIT_* seeding of the means (see init.h)
+    int kmeans_iters;       // --kmeans: max k-means iterations before the EM, 0 for none
+    int k_max;              // -k <min>:<max>: largest K of the sweep (see model_selection.h), 0 for a single K
+    int criterion;          // --criterion: CRITERION_BIC or CRITERION_AIC, to choose K
+    int n_init;             // --n-init: independent initializations (seeds seed, seed + 1, ...), the best fit is kept
+    int cov_type;           // --covariance: COV_* form of the component covariances
+    char convert_path[256]; // -c: write the dataset in binary format there and exit
+    char weights[256];      // --weights: relative share of the points of each MPI process, "w0,w1,..."
+    int affinity;           // --affinity: AFFINITY_REPORT or AFFINITY_PIN the OpenMP threads, 0 to leave them alone
+    int online;             // --online: points per mini-batch (per MPI process) of the online EM, 0 for batch EM
+    int epochs;             // --epochs: passes of the online EM over the dataset
+    double lr_decay;        // --lr-decay, --lr-offset: online EM step size (t + lr_offset)^-lr_decay at step t
+    double lr_offset;
+    char checkpoint_path[256]; // --checkpoint: EM state saved there every checkpoint_every iterations (see model.h)
+    int checkpoint_every;
+    char resume_path[256];  // --resume: continue from this checkpoint (if it exists)
+    char init_model[256];   // --init-model: start from a saved model instead of init_gmm
+    char save_model[256];   // --save-model: fitted model written there (binary, or JSON for a .json path)
+    char predict_model[256]; // --predict: score the dataset with this saved model instead of running EM
+    int output_columns;     // --output-format: RESULTS_* columns of the result file (see results.h), -1 for the mode's default
+    int output_binary;      // and whether it is written as binary records
+    int start_iter;         // First iteration and previous log-likelihood, set when resuming
+    double start_log_lik;
+    int max_iter;           // Iteration to stop at: MAX_ITER, fewer while --n-init probes the restarts
+#ifdef USE_MPI
+    MPI_Comm comm;          // Processes of the fit: MPI_COMM_WORLD, or one group of them per concurrent --n-init restart
+#endif
+} EMOptions;
+
+// Covariance models (--covariance). The matrices are always stored in full,
+// the M-step projects them onto the chosen form and the E-step uses the
+// kernel of that form:
+//   COV_FULL       any covariance per component, O(D^2) per point and component
+//   COV_DIAG       diagonal per component (independent features), O(D)
+//   COV_SPHERICAL  sigma_k^2 I per component, O(D)
+//   COV_TIED       one full covariance shared by all components, one O(D^2)
+//                  whitening per point, then O(D) per component
+#define COV_FULL 0
+#define COV_DIAG 1
+#define COV_SPHERICAL 2
+#define COV_TIED 3
 
+// Gaussian Mixture Model parameters. All arrays live in one 64-byte aligned
+// block (see alloc_gmm), each array and each component's mean/matrix start
+// on a cache line so the whole model can be sent with a single MPI call.
 typedef struct {
-    double *mean;      // Mean vector
-    double **cov;      // Covariance matrix
-    double weight;     // Mixture weight (pi_k)
-    double class_resp; // Class responsibility
-} Gaussian;
-
-T multiv_gaussian_pdf(T* x, int dim, T* means, T** cov_matrix);
-void em_algorithm(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, int* labels);
-T log_likelihood(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters);
+    int num_clusters;
+    int dim;
+    int vec_stride;    // Elements between two components' means (dim, padded)
+    int mat_stride;    // Elements between two components' matrices (dim*dim, padded)
+    int cov_type;      // COV_* form of covs
+
+    T *weights;        // Mixture weights (pi_k), K
+    T *means;          // Mean vectors, K x vec_stride
+    T *covs;           // Covariance matrices, row-major, K x mat_stride
+    T *class_resp;     // Class responsibilities, K
+
+    // Per-iteration cache, rebuilt by precompute_gaussians() after every M-step
+    T *chols;          // Lower Cholesky factors of covs, K x mat_stride (COV_TIED: the shared one, in chols[0])
+    T *prec_vecs;      // K x vec_stride: 1 / sigma_k per feature (COV_DIAG, COV_SPHERICAL), L^-1 mean_k (COV_TIED)
+    T *log_dets;       // log(det(cov_k))
+    T *log_weights;    // log(weight_k)
+    T *log_norms;      // -0.5 * (dim * log(2*PI) + log_det_k)
+
+    void *block;       // Backing allocation of all the arrays above
+    size_t block_size; // In bytes
+} GMM;
+
+static inline T* gmm_mean(GMM* gmm, int k) { return gmm->means + (size_t)k * gmm->vec_stride; }
+static inline T* gmm_cov(GMM* gmm, int k) { return gmm->covs + (size_t)k * gmm->mat_stride; }
+static inline T* gmm_chol(GMM* gmm, int k) { return gmm->chols + (size_t)k * gmm->mat_stride; }
+
+GMM* alloc_gmm(int num_clusters, int dim, int cov_type);
+void free_gmm(GMM* gmm);
+int parse_cov_type(const char* name, int* cov_type);
+const char* cov_type_name(int cov_type);
+void constrain_covariances(GMM* gmm);
+void precompute_gaussians(GMM* gmm, int num_clusters, int dim);
+T log_multiv_gaussian_pdf(T* x, int dim, GMM* gmm, int k);
+T multiv_gaussian_pdf(T* x, int dim, GMM* gmm, int k);
+void log_joint_block(const T* x, int count, int dim, GMM* gmm, int num_clusters, T* log_joint);
+double em_algorithm(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels, EMOptions* options);
+T log_sum_exp_normalize(T* log_resp, int num_clusters);
+double log_likelihood(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters);
+void predict_labels(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef __DATASET_H_
+#define __DATASET_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "commons.h"
+
+/* Binary dataset format (".bin"), all fields in the writer's byte order:
+ *
+ *   offset  0  char     magic[8]      "EMDATA01"
+ *   offset  8  uint32   endian_tag    0x01020304, tells the reader the byte order
+ *   offset 12  uint32   dtype         DATASET_FLOAT32 or DATASET_FLOAT64
+ *   offset 16  uint64   num_points    N
+ *   offset 24  uint32   dim           D
+ *   offset 28  uint32   has_labels    1 if an int32 label per point follows the data
+ *   offset 32  uint64   data_offset   DATASET_HEADER_SIZE
+ *   offset 40  uint64   labels_offset 0 without labels
+ *   offset 48  (padding up to DATASET_HEADER_SIZE)
+ *
+ * followed by the N x D points, row-major, and the optional N labels.
+ * When dtype matches T and the byte order is native the points are used
+ * in place from the mapping, otherwise they are converted into a copy.
+ * N is 64-bit: a file may hold any number of points, but a slice loaded
+ * at once (a Dataset, e.g. one chunk of the online EM) is limited to
+ * INT_MAX coordinates.
+ */
+#define DATASET_MAGIC "EMDATA01"
+#define DATASET_ENDIAN_TAG 0x01020304u
+#define DATASET_HEADER_SIZE 64
+#define DATASET_FLOAT32 1
+#define DATASET_FLOAT64 2
+
+typedef struct {
+    char magic[8];
+    uint32_t endian_tag;
+    uint32_t dtype;
+    uint64_t num_points;
+    uint32_t dim;
+    uint32_t has_labels;
+    uint64_t data_offset;
+    uint64_t labels_offset;
+    char padding[DATASET_HEADER_SIZE - 48];
+} DatasetHeader;
+
+// Points of a dataset (or of a slice of it) in memory
+typedef struct {
+    T *data;          // num_points x dim, row-major
+    int *labels;      // Labels stored with the points, NULL if none
+    int num_points;
+    int dim;
+    void *map;        // File mapping 'data' points into, NULL if 'data' is heap allocated
+    size_t map_size;
+} Dataset;
+
+// A dataset read one block of points ("chunk") at a time, for files that
+// do not fit in memory (online EM). Chunks of a binary file hold exactly
+// 'chunk_points' points (the last one fewer), those of a CSV are equal
+// byte ranges sized from the average row length of the first rows.
+typedef struct {
+    char path[256];
+    int binary;
+    int num_chunks;
+    int chunk_points;
+    long long num_points; // -1 for a CSV, known only once every chunk is read
+} DatasetChunks;
+
+int dataset_is_binary(const char *path);
+int dataset_info(const char *path, long long *num_points, int *dim);
+int load_dataset(const char *path, Dataset *ds);
+int load_dataset_rows(const char *path, long long first_point, long long num_points, Dataset *ds);
+int load_dataset_part(const char *path, const int *weights, int part, int num_parts, Dataset *ds);
+void partition_range(long long total, const int *weights, int part, int num_parts, long long *begin, long long *end);
+int write_dataset_bin(const char *path, const T *data, const int *labels, int num_points, int dim);
+void free_dataset(Dataset *ds);
+int dataset_chunks_open(const char *path, int chunk_points, DatasetChunks *chunks);
+int dataset_chunk_load(const DatasetChunks *chunks, int chunk, Dataset *ds);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __INIT_H_
+#define __INIT_H_
+#include "commons.h"
+
+/* Initial GMM parameters (--init): the K means are seeded by one of
+ *
+ *   farthest    a random point, then each time the point farthest from the
+ *               means chosen so far (default)
+ *   kmeans++    a random point, then points drawn with probability
+ *               proportional to their squared distance to the closest
+ *               chosen mean (D^2 weighting, Arthur and Vassilvitskii)
+ *   kmeans-par  k-means|| (Bahmani et al.): a few rounds that each draw
+ *               about KMEANS_PAR_OVERSAMPLING * K points at once, then
+ *               kmeans++ over these candidates weighted by the number of
+ *               points closest to each
+ *
+ * and every component starts from the covariance of the whole dataset and
+ * weight 1/K, unless --kmeans refines them first (see kmeans.h). All
+ * passes over the points run in parallel (OpenMP) and, in the MPI build,
+ * over the points of every process. The same --seed picks the same points
+ * for any number of threads or processes (up to the rounding of the
+ * distance sums across processes for kmeans++).
+ */
+#define INIT_FARTHEST 0
+#define INIT_KMEANSPP 1
+#define INIT_KMEANS_PAR 2
+
+#define INIT_BLOCK 4096             // Points per partial sum of the D^2 sampling
+#define KMEANS_PAR_ROUNDS 5
+#define KMEANS_PAR_OVERSAMPLING 2   // Expected candidates per round, times K
+#define KMEANS_PAR_LLOYD_ITERS 10   // Weighted Lloyd iterations over the candidates
+
+int parse_init_method(const char *name, int *method);
+
+// Collective over options->comm under MPI, 'data' being the points of the
+// calling process
+void init_gmm(GMM *gmm, int K, int dim, T *data, int N, const EMOptions *options);
+
+#endif
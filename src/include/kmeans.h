@@ -0,0 +1,17 @@
+#ifndef __KMEANS_H_
+#define __KMEANS_H_
+#include "commons.h"
+
+#define KMEANS_TOL 1e-3 // Stop once fewer than this fraction of the points change cluster
+
+// k-means warm start (--kmeans <iters>): up to options->kmeans_iters Lloyd
+// iterations from the seeded means of 'gmm', then the weight, mean and
+// covariance of every component from the points assigned to it (hard
+// responsibilities, the M-step of stats_to_gmm). A component left without
+// points keeps its mean, the covariance of the whole dataset and the
+// weight of one point. Parallel over the points (OpenMP) and, collective
+// under MPI, over the points of every process of options->comm. Returns
+// the iterations run.
+int kmeans_warm_start(GMM *gmm, int K, int dim, T *data, int N, const EMOptions *options);
+
+#endif
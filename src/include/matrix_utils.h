@@ -3,16 +3,30 @@
 #include "commons.h"
 
 // Common utility functions implemented in 'matrix_utils.c'
-T** alloc_matrix(int dim1, int dim2);
-void get_minor(T **A, T **minor, int dim, int p, int q);
-void free_matrix(T **matrix, int dim);
-void print_matrix(T **matrix, int dim);
-void mat_mult(T **matrixA, T **matrixB, T **matrixC, int dim);
-void mat_vec_mult(T **matrix, T *vec, T *result, int dim);
+// Matrices are flat, row-major buffers: element (i, j) is matrix[i * dim + j]
+T* alloc_matrix(int dim1, int dim2);
+void get_minor(T *A, T *minor, int dim, int p, int q);
+void free_matrix(T *matrix);
+void print_matrix(T *matrix, int dim);
+void mat_mult(T *matrixA, T *matrixB, T *matrixC, int dim);
+void mat_vec_mult(T *matrix, T *vec, T *result, int dim);
 T dot_product(T *vecA, T *vecB, int dim);
 
 // Matrix inversion and related functions implemented in 'matrix_inverse.c'
-int invert_matrix(T **matrix, int dim, T **matrix_inv);
-T determinant(T **matrix, int dim);
+int invert_matrix(T *matrix, int dim, T *matrix_inv);
+T determinant(T *matrix, int dim);
+
+// Cholesky factorization and related functions implemented in 'matrix_cholesky.c'
+int cholesky_decompose(T *A, int dim, T *L);
+T cholesky_log_det(T *L, int dim);
+T cholesky_mahalanobis(T *L, T *v, int dim);
+
+// Batched SIMD kernels implemented in 'matrix_mahalanobis.c'
+void mahalanobis_block(const T *x, int count, int dim, const T *mean, const T *L, T *dist, T *work);
+const char* mahalanobis_kernel_isa(void);
+void transpose_block(const T *x, int count, int dim, T *xt);
+void diag_mahalanobis_block(const T *xt, int dim, const T *mean, const T *inv_sd, T *dist);
+void whiten_block(T *xt, int dim, const T *L);
+void sq_dist_block(const T *zt, int dim, const T *center, T *dist);
 
 #endif
\ No newline at end of file
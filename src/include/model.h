@@ -0,0 +1,50 @@
+#ifndef __MODEL_H_
+#define __MODEL_H_
+#include <stdint.h>
+#include "commons.h"
+
+/* Model file (".gmm"): the parameters of a fitted, or still running, GMM
+ * in the writer's byte order (only native files are read):
+ *
+ *   offset  0  char     magic[8]      "EMMODEL1"
+ *   offset  8  uint32   endian_tag    0x01020304
+ *   offset 12  uint32   num_clusters  K
+ *   offset 16  uint32   dim           D
+ *   offset 20  uint32   iteration     EM iterations done, the next one to run on --resume
+ *   offset 24  double   log_lik       log-likelihood of the last E-step, -inf if none
+ *   offset 32  uint32   cov_type      COV_* covariance model (0, full, in older files)
+ *   offset 36  (padding up to MODEL_HEADER_SIZE)
+ *
+ * followed by K weights, K x D means and K x D x D covariances, all in
+ * double whatever T is, so a checkpoint resumes bit for bit. The
+ * covariances are stored in full whatever the covariance model.
+ *
+ * --save-model writes the same file for a fitted model (iteration 0), or a
+ * JSON document with the precision matrices as well for other tools when
+ * the path ends in ".json".
+ */
+#define MODEL_MAGIC "EMMODEL1"
+#define MODEL_ENDIAN_TAG 0x01020304u
+#define MODEL_HEADER_SIZE 64
+#define DEFAULT_CHECKPOINT_EVERY 10
+
+typedef struct {
+    char magic[8];
+    uint32_t endian_tag;
+    uint32_t num_clusters;
+    uint32_t dim;
+    uint32_t iteration;
+    double log_lik;
+    uint32_t cov_type;
+    char padding[MODEL_HEADER_SIZE - 36];
+} ModelHeader;
+
+int save_model(const char *path, GMM *gmm, int iteration, double log_lik);
+int load_model(const char *path, GMM *gmm, int *iteration, double *log_lik);
+int model_info(const char *path, int *num_clusters, int *dim, int *cov_type);
+int save_model_json(const char *path, GMM *gmm);
+int export_model(const char *path, GMM *gmm);
+int load_start_model(GMM *gmm, EMOptions *options);
+void checkpoint_em(const EMOptions *options, GMM *gmm, int next_iter, double prev_log_lik, int force);
+
+#endif
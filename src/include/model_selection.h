@@ -0,0 +1,26 @@
+#ifndef __MODEL_SELECTION_H_
+#define __MODEL_SELECTION_H_
+#include "commons.h"
+
+#define CRITERION_BIC 0
+#define CRITERION_AIC 1
+
+// Free parameters of a GMM: K - 1 weights, K means and the covariances,
+// K symmetric matrices (full), K diagonals (diag), K variances (spherical)
+// or one symmetric matrix (tied)
+#define COV_NUM_PARAMS(K, dim, cov_type) \
+    ((cov_type) == COV_DIAG ? (double)(K) * (dim) : \
+     (cov_type) == COV_SPHERICAL ? (double)(K) : \
+     (cov_type) == COV_TIED ? (double)(dim) * ((dim) + 1) / 2 : \
+     (double)(K) * (dim) * ((dim) + 1) / 2)
+#define GMM_NUM_PARAMS(K, dim, cov_type) \
+    ((double)((K) - 1) + (double)(K) * (dim) + COV_NUM_PARAMS(K, dim, cov_type))
+
+// -k <min>:<max>: one fit per K in [k_min, options->k_max] on the same
+// data, each from its own init_gmm (or --n-init restarts). Reports the
+// log-likelihood, BIC = -2 LL + p ln N and AIC = -2 LL + 2 p of each and
+// returns the model of lowest --criterion, 'labels' getting its labels.
+// Collective under MPI, 'data' being the local points.
+GMM* select_num_clusters(T* data_points, int dim, int num_data_points, int k_min, int* labels, EMOptions* options);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __MPI_UTILS_H_
+#define __MPI_UTILS_H_
+#include <mpi.h>
+#include "commons.h"
+#include "utils.h"
+
+// Shared result file of the ResultsWriter (results.h), written with MPI-IO
+int open_results_mpi(const char *filename, MPI_File *fh);
+long long write_blocks_mpi(MPI_File fh, long long offset, const TextBuffer *blocks, int num_blocks);
+
+// Rows of a global array laid out one way over the processes of 'comm' into
+// another layout ('row' is the datatype of one row). The rank holds
+// [src_first, src_first + src_rows) and receives [dst_first, dst_first + dst_rows).
+// The wanted ranges may overlap, e.g. each group of ranks wanting all the rows. Collective.
+void redistribute_rows(const void *src, long long src_first, int src_rows, void *dst, long long dst_first,
+                       int dst_rows, MPI_Datatype row, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __OMP_UTILS_H_
+#define __OMP_UTILS_H_
+#include <stddef.h>
+#include "commons.h"
+#include "dataset.h"
+
+// NUMA placement for the OpenMP build. Every per-point buffer is first
+// touched with the partition of the compute loops (schedule(static) over
+// blocks of POINT_BLOCK points), so each thread's points sit on its node.
+int numa_num_nodes(void);
+void* first_touch_alloc(int num_points, size_t bytes_per_point);
+void place_dataset(Dataset *ds);
+
+// --affinity: 'pin' binds thread t to the t-th CPU the process may run on,
+// both modes print the CPU and NUMA node of every thread
+void pin_threads(void);
+void report_affinity(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __ONLINE_EM_H_
+#define __ONLINE_EM_H_
+#include "commons.h"
+
+// Online (stepwise) EM over a dataset read one mini-batch at a time, see
+// src/online_em.c. Returns the fitted model, NULL if the dataset cannot be
+// opened; '*num_points' gets the size of the dataset.
+GMM* online_em(const char *dataset_path, const char *output_path, int num_clusters,
+               EMOptions *options, long long *num_points);
+
+#endif
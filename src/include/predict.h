@@ -0,0 +1,15 @@
+#ifndef __PREDICT_H_
+#define __PREDICT_H_
+#include "commons.h"
+
+#define PREDICT_CHUNK_POINTS 65536 // Points per process scored at a time
+
+// Predict-only mode (--predict): scores a dataset with a saved model in
+// one streaming pass, no EM. Every output row holds (by default, see
+// --output-format) the label, the log density log p(x) and the K
+// responsibilities of the input row with the same index. Returns 0, or -1
+// if the model or dataset cannot be read.
+int predict(const char *model_path, const char *dataset_path, const char *output_path, const EMOptions *options);
+void score_points(T* data_points, int num_data_points, GMM* gmm, T* resp, T* log_density, int* labels);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __RESTARTS_H_
+#define __RESTARTS_H_
+#include "commons.h"
+
+#define NINIT_PROBE_ITERS 10      // EM iterations of every restart before the weak ones are dropped
+#define NINIT_ABANDON_GAP 0.01    // Log-likelihood per point behind the best restart that drops one
+
+// --n-init: EM from options->n_init initializations (init_gmm with seeds
+// seed, seed + 1, ...), several at the same time. The MPI builds split the
+// processes of options->comm into up to n_init groups (MPI_Comm_split of
+// consecutive ranks). Each group gets its own copy of all the points,
+// spread evenly over its processes. The OpenMP build splits the threads
+// into as many nested teams, each with its own scratch arenas (see
+// scratch.h). Restart r runs on group r % groups, after the group's
+// earlier ones when there are more restarts than groups. Every restart
+// first runs NINIT_PROBE_ITERS iterations. One reduction across the groups
+// then drops those behind the best one by more than NINIT_ABANDON_GAP per
+// point, and the others run to convergence. 'gmm' and 'labels' get the
+// fit of highest log-likelihood, which is returned. Collective under MPI,
+// 'data' being the local points. Memory grows with the groups: a process
+// holds about 'groups' times its share of the points, and a team (OpenMP)
+// its own responsibility matrix.
+double fit_restarts(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels,
+                    EMOptions* options);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __RESULTS_H_
+#define __RESULTS_H_
+#include <stdio.h>
+#include <stdint.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+#include "commons.h"
+#include "utils.h"
+
+/* Result files (-o), selected with --output-format:
+ *
+ *   csv                x1..xD,label      the input points with their label (default)
+ *   labels             label             one label per line
+ *   resp               label,log_density,p1..pK (of the final model)
+ *   bin, labels-bin,   the same columns as fixed-size binary records
+ *   resp-bin
+ *
+ * Labels are written 1-based. Text values are formatted like "%.6f" by a
+ * printf-free formatter (same bytes). Binary files start with a header, in
+ * the writer's byte order,
+ *
+ *   offset  0  char     magic[8]     "EMRESULT"
+ *   offset  8  uint32   endian_tag   0x01020304
+ *   offset 12  uint32   dtype        DATASET_FLOAT32 or DATASET_FLOAT64
+ *   offset 16  uint32   columns      RESULTS_POINTS, RESULTS_LABELS or RESULTS_RESP
+ *   offset 20  uint32   num_values   values per record: D, 0 or K + 1
+ *   offset 24  (padding up to RESULTS_HEADER_SIZE)
+ *
+ * followed by one record per point: int32 label, then num_values values
+ * (coordinates, or log_density and p1..pK) of type dtype, unaligned. The
+ * number of points is (file size - RESULTS_HEADER_SIZE) / record size.
+ */
+#define RESULTS_MAGIC "EMRESULT"
+#define RESULTS_HEADER_SIZE 32
+#define RESULTS_DEFAULT -1 // csv for a fit, resp for --predict
+#define RESULTS_POINTS 0
+#define RESULTS_LABELS 1
+#define RESULTS_RESP 2
+#define RESULTS_BLOCK_ROWS 4096 // Rows formatted by one thread at a time
+
+typedef struct {
+    char magic[8];
+    uint32_t endian_tag;
+    uint32_t dtype;
+    uint32_t columns;
+    uint32_t num_values;
+    char padding[RESULTS_HEADER_SIZE - 24];
+} ResultsHeader;
+
+// Columns of a block of output rows; only those of the file's format are read
+typedef struct {
+    const T *points;       // RESULTS_POINTS: N x D
+    const T *resp;         // RESULTS_RESP: N x K responsibilities
+    const T *log_density;  // RESULTS_RESP: log p(x) of every point
+    const int *labels;     // 0-based
+} ResultRows;
+
+// An open result file. Rows are appended in order; under MPI every call
+// is collective and the rows of a process follow those of the lower ranks.
+typedef struct {
+    int columns;
+    int binary;
+    int num_values;
+    long long offset;      // Bytes written so far (all processes)
+    TextBuffer *blocks;    // One formatting buffer per block of rows in flight
+    int num_blocks;
+#ifdef USE_MPI
+    MPI_File fh;
+#else
+    FILE *fp;
+#endif
+} ResultsWriter;
+
+int parse_output_format(const char *name, int *columns, int *binary);
+int results_open(ResultsWriter *w, const char *path, int columns, int binary, int num_values);
+int results_write(ResultsWriter *w, const ResultRows *rows, int num_rows);
+int results_close(ResultsWriter *w);
+int results_num_values(int columns, const GMM *gmm);
+int results_write_points(ResultsWriter *w, T *data, int num_points, GMM *gmm, int *labels);
+int write_results(const char *path, const EMOptions *options, T *data, int *labels, GMM *gmm, int num_points);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __SCRATCH_H_
+#define __SCRATCH_H_
+#include <stddef.h>
+
+#define SCRATCH_ALIGN 64 // cache line
+
+// Bump allocator for temporaries: one arena per OpenMP thread (or per
+// process in the sequential and MPI builds), allocated once by
+// scratch_setup() so the EM iterations never touch the heap. Between
+// scratch_teams(n) and scratch_teams(0) every thread of the parallel region
+// opened next is the master of a team of its own (nested parallelism), and
+// each team sets up and uses its own arenas.
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+} Scratch;
+
+// Upper bound of the arena size needed for 'num_elems' values split over 'num_allocs' allocations
+#define SCRATCH_BYTES(num_elems, elem_size, num_allocs) \
+    ((size_t)(num_elems) * (elem_size) + (size_t)(num_allocs) * SCRATCH_ALIGN)
+
+#ifdef _OPENMP
+void scratch_teams(int num_teams);
+#endif
+void scratch_setup(size_t bytes_per_thread);
+void scratch_teardown(void);
+Scratch* thread_scratch(void);
+void* scratch_alloc(Scratch *s, size_t bytes);
+void* scratch_calloc(Scratch *s, size_t bytes);
+
+// Everything allocated after a mark is released at once
+static inline size_t scratch_mark(Scratch *s) { return s->used; }
+static inline void scratch_release(Scratch *s, size_t mark) { s->used = mark; }
+
+#ifdef DEBUG_ALLOC
+#include <stdio.h>
+// Number of malloc/calloc/realloc calls since program start (debug builds only)
+long alloc_count(void);
+
+// Counts the heap allocations of every EM iteration after the first one
+#define ALLOC_CHECK_DEF() \
+    long _steady_state_allocs = -1;
+
+#define ALLOC_CHECK_START(iter) \
+    if ((iter) == 1) _steady_state_allocs = alloc_count();
+
+#define ALLOC_CHECK_PRINT() \
+    if (_steady_state_allocs >= 0) \
+        printf("[DEBUG] Heap allocations after the first iteration: %ld\n", alloc_count() - _steady_state_allocs);
+
+#else
+#define ALLOC_CHECK_DEF()
+#define ALLOC_CHECK_START(iter)
+#define ALLOC_CHECK_PRINT()
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __SUFF_STATS_H_
+#define __SUFF_STATS_H_
+#include "commons.h"
+#include "scratch.h"
+
+// Number of unique entries of a symmetric dim x dim matrix (packed upper triangle)
+#define PACKED_SIZE(dim) ((dim) * ((dim) + 1) / 2)
+
+// Elements of one SuffStats buffer, for sizing scratch arenas
+#define STATS_ELEMS(num_clusters, dim) \
+    ((size_t)(num_clusters) * (1 + (dim) + PACKED_SIZE(dim)) + 1)
+
+// Sufficient statistics of the M-step for all K components, accumulated in
+// double. Points are shifted by the current mean c_k of each component
+// (the 'shift') so that the centered covariance form stays accurate:
+//   resp_sum[k] = sum_n r_nk
+//   x_sum[k]    = sum_n r_nk (x_n - c_k)
+//   xx_sum[k]   = sum_n r_nk (x_n - c_k)(x_n - c_k)^T   (packed upper triangle)
+// plus the log-likelihood of the points seen so far (streaming E-step).
+// All of them are views of one contiguous buffer 'data'.
+typedef struct {
+    int num_clusters;
+    int dim;
+    double *resp_sum;  // K
+    double *x_sum;     // K x dim
+    double *xx_sum;    // K x PACKED_SIZE(dim)
+    double *log_lik;   // 1
+    double *data;      // Backing buffer of STATS_ELEMS(K, dim) doubles
+    size_t size;       // STATS_ELEMS(K, dim)
+} SuffStats;
+
+void stats_init(SuffStats *stats, int num_clusters, int dim, double *buffer);
+void stats_init_scratch(SuffStats *stats, int num_clusters, int dim, Scratch *scratch);
+void stats_zero(SuffStats *stats);
+void stats_accumulate(SuffStats *stats, const T *x, const T *resp_row, GMM *gmm);
+void stats_accumulate_block(SuffStats *stats, const T *x, int count, GMM *gmm);
+void stats_add(SuffStats *dst, const SuffStats *src);
+void stats_to_gmm(const SuffStats *stats, GMM *gmm, double total_resp);
+void stats_step_gmm(const SuffStats *batch, GMM *gmm, double step);
+
+#endif
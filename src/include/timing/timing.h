@@ -2,7 +2,18 @@
 #define __TIMING_H__
 
 #include <stdio.h>
-#include <mpi.h> // Usa MPI per il timing
+
+// Wall clock used by the total timers, depending on the build
+#if defined(USE_MPI)
+#include <mpi.h>
+#define WALL_TIME() MPI_Wtime()
+#elif defined(_OPENMP)
+#include <omp.h>
+#define WALL_TIME() omp_get_wtime()
+#else
+#include <time.h>
+#define WALL_TIME() ((double)clock() / CLOCKS_PER_SEC)
+#endif
 
 
 #ifdef TIMING_BREAKDOWN
@@ -51,19 +62,34 @@
 
 #ifdef TOTAL_TIMING
 
-// Macro definitions using MPI_Wtime
+// Macro definitions using WALL_TIME
 
 #define TOTAL_TIMER_START(label) \
     double start_##label, end_##label; \
     double duration_##label = 0.0; \
-    start_##label = MPI_Wtime();
+    start_##label = WALL_TIME();
 
+#ifdef USE_MPI
 #define TOTAL_TIMER_STOP(label) \
-    end_##label = MPI_Wtime(); \
+    end_##label = WALL_TIME(); \
     duration_##label = end_##label - start_##label; \
     int _rank; MPI_Comm_rank(MPI_COMM_WORLD, &_rank); \
     if (_rank == 0) printf("\n*** " #label " execution time: %f s ***\n", duration_##label);
+#else
+#define TOTAL_TIMER_STOP(label) \
+    end_##label = WALL_TIME(); \
+    duration_##label = end_##label - start_##label; \
+    printf("\n*** " #label " execution time: %f s ***\n", duration_##label);
+#endif
 
+// Print only the measured duration (CSV friendly)
+#define GET_DURATION(label) \
+    printf("%f", duration_##label);
+
+#else
+#define TOTAL_TIMER_START(label)
+#define TOTAL_TIMER_STOP(label)
+#define GET_DURATION(label)
 #endif
 
 #endif // __TIMING_H__
\ No newline at end of file
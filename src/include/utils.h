@@ -1,10 +1,20 @@
 #ifndef __UTILS_H_
 #define __UTILS_H_
+#include <stdio.h>
 #include "commons.h"
 
-void parsing(int argc, char *argv[], int *num_clusters, char *dataset_path, char *output_path);
-T* load_csv(const char* filename, int* num_rows, int* num_cols);
-void write_results_csv(const char *filename, T *data, int *labels, int N, int dim);
-void init_gmm(Gaussian *gmm, int K, int dim, T *data, int N);
+// Growable text buffer for formatted output
+typedef struct {
+    char *data;
+    size_t len, cap;
+} TextBuffer;
+
+void text_append(TextBuffer *b, const char *fmt, ...);
+void text_reserve(TextBuffer *b, size_t bytes);
+void parsing(int argc, char *argv[], int *num_clusters, char *dataset_path, char *output_path, EMOptions *options);
+T* load_csv(const char* filename, int* num_rows, int* num_cols, int** labels);
+T* load_csv_part(const char* filename, const int* weights, int part, int num_parts,
+                 int* num_rows, int* num_cols, int** labels);
+void print_cluster_params(GMM *gmm);
 
 #endif
\ No newline at end of file
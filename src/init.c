@@ -0,0 +1,535 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "include/commons.h"
+#include "include/init.h"
+#include "include/kmeans.h"
+
+// Points of the calling process and the distance of each to the closest
+// mean chosen so far
+typedef struct {
+    T *data;
+    int n, dim;
+    int first, N;        // Global index of the first local point, points of all processes
+    int rank, size;
+#ifdef USE_MPI
+    MPI_Comm comm;       // Processes sharing the points (options->comm)
+#endif
+    T *min_dist;         // Squared distance to the closest chosen mean, n
+    int *closest;        // k-means||: index of that mean (candidate), n
+    double *block_sum;   // Sum of min_dist per INIT_BLOCK points
+    int *block_count;
+    int num_blocks;
+    double *buf;         // dim values sent to all processes
+} InitState;
+
+int parse_init_method(const char *name, int *method) {
+    if (strcmp(name, "farthest") == 0) *method = INIT_FARTHEST;
+    else if (strcmp(name, "kmeans++") == 0) *method = INIT_KMEANSPP;
+    else if (strcmp(name, "kmeans-par") == 0) *method = INIT_KMEANS_PAR;
+    else return -1;
+    return 0;
+}
+
+static T sq_dist(const T *x, const T *mean, int dim) {
+    T dist = 0.0;
+    for (int d = 0; d < dim; d++) {
+        T diff = x[d] - mean[d];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+static double uniform(void) {
+    return rand() / ((double)RAND_MAX + 1.0);
+}
+
+// Uniform in [0, 1) from (seed, round, point): the same draw for a point
+// whichever thread or process holds it
+static double point_uniform(unsigned int seed, int round, int idx) {
+    // splitmix64 of the point's index, in a stream of its own per seed and round
+    uint64_t z = ((uint64_t)seed << 32 | (uint32_t)round) + ((uint64_t)idx + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double sum_all(InitState *s, double v) {
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &v, 1, MPI_DOUBLE, MPI_SUM, s->comm);
+#else
+    (void)s;
+#endif
+    return v;
+}
+
+// Global point 'idx' on every process: its owner contributes it, the others zeros
+static void fetch_point(InitState *s, int idx, T *point) {
+#ifdef USE_MPI
+    int owner = (idx >= s->first && idx < s->first + s->n);
+    for (int d = 0; d < s->dim; d++)
+        s->buf[d] = owner ? s->data[(size_t)(idx - s->first) * s->dim + d] : 0.0;
+    MPI_Allreduce(MPI_IN_PLACE, s->buf, s->dim, MPI_DOUBLE, MPI_SUM, s->comm);
+    for (int d = 0; d < s->dim; d++)
+        point[d] = s->buf[d];
+#else
+    memcpy(point, &s->data[(size_t)idx * s->dim], s->dim * sizeof(T));
+#endif
+}
+
+// min_dist of every point lowered to its distance to 'num_means' new
+// means, numbered from 'first_mean' in closest[]
+static void update_min_dist(InitState *s, const T *means, int num_means, int stride, int first_mean) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < s->n; i++) {
+        const T *x = &s->data[(size_t)i * s->dim];
+        for (int j = 0; j < num_means; j++) {
+            T dist = sq_dist(x, &means[(size_t)j * stride], s->dim);
+            if (dist < s->min_dist[i]) {
+                s->min_dist[i] = dist;
+                if (s->closest) s->closest[i] = first_mean + j;
+            }
+        }
+    }
+}
+
+// Sum of min_dist over all points, block by block in a fixed order so the
+// result does not depend on the number of threads
+static double total_min_dist(InitState *s) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int b = 0; b < s->num_blocks; b++) {
+        int end = (b + 1) * INIT_BLOCK < s->n ? (b + 1) * INIT_BLOCK : s->n;
+        double sum = 0.0;
+        for (int i = b * INIT_BLOCK; i < end; i++)
+            sum += s->min_dist[i];
+        s->block_sum[b] = sum;
+    }
+    double local = 0.0;
+    for (int b = 0; b < s->num_blocks; b++)
+        local += s->block_sum[b];
+    return local;
+}
+
+// Point farthest from the chosen means (lowest index on ties)
+static int farthest_point(InitState *s) {
+    struct { double dist; int idx; } best = { -1.0, 0 };
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        struct { double dist; int idx; } local = { -1.0, 0 };
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int i = 0; i < s->n; i++) {
+            if (s->min_dist[i] > local.dist) {
+                local.dist = s->min_dist[i];
+                local.idx = s->first + i;
+            }
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        {
+            if (local.dist > best.dist || (local.dist == best.dist && local.idx < best.idx)) {
+                best.dist = local.dist;
+                best.idx = local.idx;
+            }
+        }
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &best, 1, MPI_DOUBLE_INT, MPI_MAXLOC, s->comm);
+#endif
+    return best.idx;
+}
+
+// Point drawn with probability min_dist / sum of min_dist, 'u' uniform in
+// [0, 1) and the same on all processes
+static int sample_point(InitState *s, double u) {
+    double local = total_min_dist(s);
+    double *totals = (double*)malloc(s->size * sizeof(double));
+#ifdef USE_MPI
+    MPI_Allgather(&local, 1, MPI_DOUBLE, totals, 1, MPI_DOUBLE, s->comm);
+#else
+    totals[0] = local;
+#endif
+    double total = 0.0;
+    for (int r = 0; r < s->size; r++) total += totals[r];
+    if (!(total > 0.0)) {
+        // every point sits on a chosen mean
+        free(totals);
+        return (int)(u * s->N);
+    }
+
+    // the process, then the block, then the point holding the target; a
+    // target past the end (rounding) takes the last one with a weight
+    double target = u * total, acc = 0.0, start = 0.0;
+    int owner = 0;
+    for (int r = 0; r < s->size; r++) {
+        if (totals[r] > 0.0) {
+            owner = r;
+            start = acc;
+            if (target < acc + totals[r]) break;
+        }
+        acc += totals[r];
+    }
+    free(totals);
+
+    int idx = -1;
+    if (s->rank == owner) {
+        int block = 0;
+        acc = start;
+        for (int b = 0; b < s->num_blocks; b++) {
+            if (s->block_sum[b] > 0.0) {
+                block = b;
+                start = acc;
+                if (target < acc + s->block_sum[b]) break;
+            }
+            acc += s->block_sum[b];
+        }
+        int end = (block + 1) * INIT_BLOCK < s->n ? (block + 1) * INIT_BLOCK : s->n;
+        acc = start;
+        for (int i = block * INIT_BLOCK; i < end; i++) {
+            if (s->min_dist[i] > 0.0) {
+                idx = s->first + i;
+                acc += s->min_dist[i];
+                if (target < acc) break;
+            }
+        }
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &idx, 1, MPI_INT, MPI_MAX, s->comm);
+#endif
+    return idx;
+}
+
+// Means k0..K-1, each the point farthest from the previous ones
+static void init_farthest(InitState *s, GMM *gmm, int k0, int K) {
+    for (int k = k0; k < K; k++) {
+        fetch_point(s, farthest_point(s), gmm_mean(gmm, k));
+        update_min_dist(s, gmm_mean(gmm, k), 1, gmm->vec_stride, k);
+    }
+}
+
+// Means k0..K-1 drawn by D^2 weighting
+static void init_kmeanspp(InitState *s, GMM *gmm, int k0, int K) {
+    for (int k = k0; k < K; k++) {
+        fetch_point(s, sample_point(s, uniform()), gmm_mean(gmm, k));
+        update_min_dist(s, gmm_mean(gmm, k), 1, gmm->vec_stride, k);
+    }
+}
+
+// Candidates of one k-means|| round: every point independently with
+// probability oversampling * min_dist / total, appended to 'cand' on all processes
+static int sample_candidates(InitState *s, unsigned int seed, int round, double oversampling,
+                             double total, T **cand, int num_cand) {
+    int dim = s->dim;
+
+    // count per block, then every block copies its points at its offset
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int b = 0; b < s->num_blocks; b++) {
+        int end = (b + 1) * INIT_BLOCK < s->n ? (b + 1) * INIT_BLOCK : s->n, count = 0;
+        for (int i = b * INIT_BLOCK; i < end; i++)
+            count += point_uniform(seed, round, s->first + i) * total < oversampling * s->min_dist[i];
+        s->block_count[b] = count;
+    }
+    int local = 0;
+    for (int b = 0; b < s->num_blocks; b++) {
+        int count = s->block_count[b];
+        s->block_count[b] = local;
+        local += count;
+    }
+
+    int *counts = (int*)malloc(s->size * sizeof(int));
+    int *displs = (int*)malloc(s->size * sizeof(int));
+#ifdef USE_MPI
+    MPI_Allgather(&local, 1, MPI_INT, counts, 1, MPI_INT, s->comm);
+#else
+    counts[0] = local;
+#endif
+    int added = 0;
+    for (int r = 0; r < s->size; r++) {
+        displs[r] = (num_cand + added) * dim;
+        added += counts[r];
+        counts[r] *= dim;
+    }
+    *cand = (T*)realloc(*cand, ((size_t)(num_cand + added) * dim + 1) * sizeof(T));
+    T *mine = &(*cand)[displs[s->rank]];
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int b = 0; b < s->num_blocks; b++) {
+        int end = (b + 1) * INIT_BLOCK < s->n ? (b + 1) * INIT_BLOCK : s->n, at = s->block_count[b];
+        for (int i = b * INIT_BLOCK; i < end; i++) {
+            if (point_uniform(seed, round, s->first + i) * total < oversampling * s->min_dist[i])
+                memcpy(&mine[(size_t)at++ * dim], &s->data[(size_t)i * dim], dim * sizeof(T));
+        }
+    }
+#ifdef USE_MPI
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, *cand, counts, displs, MPI_T, s->comm);
+#endif
+    free(counts);
+    free(displs);
+    return num_cand + added;
+}
+
+// Number of points (of all processes) closest to each candidate
+static void candidate_weights(InitState *s, int num_cand, double *weights) {
+    memset(weights, 0, num_cand * sizeof(double));
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        double *local = (double*)calloc(num_cand, sizeof(double));
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int i = 0; i < s->n; i++)
+            local[s->closest[i]] += 1.0;
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (int c = 0; c < num_cand; c++)
+            weights[c] += local[c];
+        free(local);
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, weights, num_cand, MPI_DOUBLE, MPI_SUM, s->comm);
+#endif
+}
+
+// K means out of the weighted candidates: weighted kmeans++, then a few
+// weighted Lloyd iterations. Small and identical on every process.
+static void recluster(const T *cand, const double *weights, int num_cand, int dim, GMM *gmm, int K) {
+    double *min_dist = (double*)malloc(num_cand * sizeof(double));
+    double *sums = (double*)malloc(((size_t)K * dim + K) * sizeof(double));
+    double *counts = sums + (size_t)K * dim;
+    int *closest = (int*)malloc(num_cand * sizeof(int));
+    for (int c = 0; c < num_cand; c++) min_dist[c] = INFINITY;
+
+    // the first mean by weight alone
+    for (int k = 0; k < K; k++) {
+        double total = 0.0;
+        for (int c = 0; c < num_cand; c++) total += k ? weights[c] * min_dist[c] : weights[c];
+        double target = uniform() * total, acc = 0.0;
+        int pick = -1;
+        for (int c = 0; c < num_cand; c++) {
+            double p = k ? weights[c] * min_dist[c] : weights[c];
+            if (p <= 0.0) continue;
+            pick = c;
+            acc += p;
+            if (target < acc) break;
+        }
+        if (pick < 0) pick = k % num_cand;   // fewer distinct candidates than K
+        memcpy(gmm_mean(gmm, k), &cand[(size_t)pick * dim], dim * sizeof(T));
+        for (int c = 0; c < num_cand; c++) {
+            double dist = sq_dist(&cand[(size_t)c * dim], gmm_mean(gmm, k), dim);
+            if (dist < min_dist[c]) min_dist[c] = dist;
+        }
+    }
+
+    for (int iter = 0; iter < KMEANS_PAR_LLOYD_ITERS; iter++) {
+        memset(sums, 0, ((size_t)K * dim + K) * sizeof(double));
+        int changed = 0;
+        for (int c = 0; c < num_cand; c++) {
+            T min_d = INFINITY;
+            int best = 0;
+            for (int k = 0; k < K; k++) {
+                T dist = sq_dist(&cand[(size_t)c * dim], gmm_mean(gmm, k), dim);
+                if (dist < min_d) {
+                    min_d = dist;
+                    best = k;
+                }
+            }
+            changed += (iter == 0 || closest[c] != best);
+            closest[c] = best;
+            counts[best] += weights[c];
+            for (int d = 0; d < dim; d++)
+                sums[(size_t)best * dim + d] += weights[c] * cand[(size_t)c * dim + d];
+        }
+        if (!changed) break;
+        for (int k = 0; k < K; k++) {
+            if (counts[k] <= 0.0) continue;   // empty: the mean stays
+            for (int d = 0; d < dim; d++)
+                gmm_mean(gmm, k)[d] = sums[(size_t)k * dim + d] / counts[k];
+        }
+    }
+
+    free(min_dist);
+    free(sums);
+    free(closest);
+}
+
+static void init_kmeans_par(InitState *s, GMM *gmm, int K, unsigned int seed) {
+    int dim = s->dim;
+    s->closest = (int*)malloc(((size_t)s->n + 1) * sizeof(int));
+    T *cand = (T*)malloc(((size_t)dim + 1) * sizeof(T));
+    fetch_point(s, (int)(uniform() * s->N), cand);
+    update_min_dist(s, cand, 1, dim, 0);
+    int num_cand = 1;
+
+    for (int round = 0; round < KMEANS_PAR_ROUNDS; round++) {
+        double total = sum_all(s, total_min_dist(s));
+        if (!(total > 0.0)) break;
+        int before = num_cand;
+        num_cand = sample_candidates(s, seed, round, (double)KMEANS_PAR_OVERSAMPLING * K, total, &cand, num_cand);
+        update_min_dist(s, &cand[(size_t)before * dim], num_cand - before, dim, before);
+    }
+
+    if (num_cand <= K) {
+        // too few candidates to choose from: all of them, then D^2 sampling
+        for (int c = 0; c < num_cand; c++)
+            memcpy(gmm_mean(gmm, c), &cand[(size_t)c * dim], dim * sizeof(T));
+        free(s->closest);
+        s->closest = NULL;
+        init_kmeanspp(s, gmm, num_cand, K);
+    } else {
+        double *weights = (double*)malloc(num_cand * sizeof(double));
+        candidate_weights(s, num_cand, weights);
+        recluster(cand, weights, num_cand, dim, gmm, K);
+
+        free(weights);
+    }
+    free(cand);
+}
+
+// Covariance of all the points, the starting covariance of every component
+static void global_covariance(InitState *s, double *cov) {
+    int dim = s->dim;
+    double *mean = (double*)calloc(dim, sizeof(double));
+
+    // sums in double also in the float32 build
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        double *local = (double*)calloc(dim, sizeof(double));
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int i = 0; i < s->n; i++)
+            for (int d = 0; d < dim; d++)
+                local[d] += s->data[(size_t)i * dim + d];
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (int d = 0; d < dim; d++)
+            mean[d] += local[d];
+        free(local);
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, mean, dim, MPI_DOUBLE, MPI_SUM, s->comm);
+#endif
+    for (int d = 0; d < dim; d++) mean[d] /= s->N;
+
+    memset(cov, 0, (size_t)dim * dim * sizeof(double));
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        double *local = (double*)calloc((size_t)dim * dim, sizeof(double));
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int n = 0; n < s->n; n++) {
+            const T *x = &s->data[(size_t)n * dim];
+            for (int i = 0; i < dim; i++)
+                for (int j = 0; j < dim; j++)
+                    local[i * dim + j] += (x[i] - mean[i]) * (x[j] - mean[j]);
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (int i = 0; i < dim * dim; i++)
+            cov[i] += local[i];
+        free(local);
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, cov, dim * dim, MPI_DOUBLE, MPI_SUM, s->comm);
+#endif
+    for (int i = 0; i < dim * dim; i++) cov[i] /= s->N;
+
+    free(mean);
+}
+
+void init_gmm(GMM *gmm, int K, int dim, T *data, int N, const EMOptions *options) {
+    InitState s;
+    memset(&s, 0, sizeof(s));
+    s.data = data;
+    s.n = N;
+    s.dim = dim;
+    s.N = N;
+    s.size = 1;
+#ifdef USE_MPI
+    s.comm = options->comm;
+    MPI_Comm_rank(s.comm, &s.rank);
+    MPI_Comm_size(s.comm, &s.size);
+    MPI_Exscan(&N, &s.first, 1, MPI_INT, MPI_SUM, s.comm);
+    if (s.rank == 0) s.first = 0; // undefined on rank 0
+    MPI_Allreduce(&N, &s.N, 1, MPI_INT, MPI_SUM, s.comm);
+#endif
+    s.num_blocks = (N + INIT_BLOCK - 1) / INIT_BLOCK;
+    s.min_dist = (T*)malloc(((size_t)N + 1) * sizeof(T));
+    s.block_sum = (double*)malloc(((size_t)s.num_blocks + 1) * sizeof(double));
+    s.block_count = (int*)malloc(((size_t)s.num_blocks + 1) * sizeof(int));
+    s.buf = (double*)malloc((size_t)dim * dim * sizeof(double));
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < N; i++) s.min_dist[i] = INFINITY;
+
+    // --seed: the same draws on every process
+    srand(options->seed);
+
+    if (options->init_method == INIT_KMEANS_PAR) {
+        init_kmeans_par(&s, gmm, K, options->seed);
+    } else {
+        // first mean: random point
+        fetch_point(&s, rand() % s.N, gmm_mean(gmm, 0));
+        update_min_dist(&s, gmm_mean(gmm, 0), 1, gmm->vec_stride, 0);
+        if (options->init_method == INIT_KMEANSPP)
+            init_kmeanspp(&s, gmm, 1, K);
+        else
+            init_farthest(&s, gmm, 1, K);
+    }
+
+    // same covariance and weight for all clusters
+    global_covariance(&s, s.buf);
+    for (int k = 0; k < K; k++) {
+        gmm->weights[k] = 1.0 / K;
+        gmm->class_resp[k] = 0.0;
+        T *cov = gmm_cov(gmm, k);
+        for (int i = 0; i < dim * dim; i++)
+            cov[i] = s.buf[i];
+    }
+    constrain_covariances(gmm);
+
+    free(s.min_dist);
+    free(s.block_sum);
+    free(s.block_count);
+    free(s.buf);
+
+    // --kmeans: per-component parameters from a k-means clustering
+    if (options->kmeans_iters > 0) {
+        int iters = kmeans_warm_start(gmm, K, dim, data, N, options);
+        if (s.rank == 0) printf("[DEBUG] k-means warm start: %d iterations\n", iters);
+    }
+}
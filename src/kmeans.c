@@ -0,0 +1,157 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "include/commons.h"
+#include "include/suff_stats.h"
+#include "include/kmeans.h"
+
+// Closest mean of point 'x'
+static int nearest_mean(const T *x, GMM *gmm, int K, int dim) {
+    T min_dist = INFINITY;
+    int best = 0;
+    for (int k = 0; k < K; k++) {
+        const T *mean = gmm_mean(gmm, k);
+        T dist = 0.0;
+        for (int d = 0; d < dim; d++) {
+            T diff = x[d] - mean[d];
+            dist += diff * diff;
+        }
+        if (dist < min_dist) {
+            min_dist = dist;
+            best = k;
+        }
+    }
+    return best;
+}
+
+// One Lloyd iteration: every point to its closest mean (in 'assign'), then
+// every mean to the centroid of its points. Returns the points of all
+// processes that changed cluster.
+static long long lloyd_step(GMM *gmm, int K, int dim, T *data, int N, int *assign, double *sums,
+                            const EMOptions *options) {
+    double *counts = sums + (size_t)K * dim;
+    long long changed = 0;
+    memset(sums, 0, ((size_t)K * dim + K) * sizeof(double));
+
+#ifdef _OPENMP
+    #pragma omp parallel reduction(+:changed)
+#endif
+    {
+        double *local = (double*)calloc((size_t)K * dim + K, sizeof(double));
+        double *local_counts = local + (size_t)K * dim;
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int i = 0; i < N; i++) {
+            const T *x = &data[(size_t)i * dim];
+            int k = nearest_mean(x, gmm, K, dim);
+            changed += (k != assign[i]);
+            assign[i] = k;
+            local_counts[k] += 1.0;
+            for (int d = 0; d < dim; d++)
+                local[(size_t)k * dim + d] += x[d];
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (size_t j = 0; j < (size_t)K * dim + K; j++)
+            sums[j] += local[j];
+        free(local);
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, sums, K * dim + K, MPI_DOUBLE, MPI_SUM, options->comm);
+    MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_LONG_LONG, MPI_SUM, options->comm);
+#else
+    (void)options;
+#endif
+
+    for (int k = 0; k < K; k++) {
+        if (counts[k] == 0.0) continue; // empty: the mean stays
+        for (int d = 0; d < dim; d++)
+            gmm_mean(gmm, k)[d] = sums[(size_t)k * dim + d] / counts[k];
+    }
+    return changed;
+}
+
+int kmeans_warm_start(GMM *gmm, int K, int dim, T *data, int N, const EMOptions *options) {
+    long long total = N;
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_LONG_LONG, MPI_SUM, options->comm);
+#endif
+    int *assign = (int*)malloc(((size_t)N + 1) * sizeof(int));
+    double *sums = (double*)malloc(((size_t)K * dim + K) * sizeof(double));
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 0; i < N; i++) assign[i] = -1;
+
+    int iter = 0;
+    while (iter < options->kmeans_iters) {
+        long long changed = lloyd_step(gmm, K, dim, data, N, assign, sums, options);
+        iter++;
+        if (changed <= KMEANS_TOL * total) break;
+    }
+
+    // hard M-step about the final means: one-hot responsibilities of the
+    // closest mean, the statistics shifted by it as in the EM
+    SuffStats stats;
+    double *buffer = (double*)malloc(STATS_ELEMS(K, dim) * sizeof(double));
+    stats_init(&stats, K, dim, buffer);
+    stats_zero(&stats);
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        SuffStats local;
+        double *local_buffer = (double*)malloc(STATS_ELEMS(K, dim) * sizeof(double));
+        T *one_hot = (T*)calloc(K, sizeof(T));
+        stats_init(&local, K, dim, local_buffer);
+        stats_zero(&local);
+#ifdef _OPENMP
+        #pragma omp for schedule(static) nowait
+#endif
+        for (int i = 0; i < N; i++) {
+            const T *x = &data[(size_t)i * dim];
+            int k = nearest_mean(x, gmm, K, dim);
+            one_hot[k] = 1.0;
+            stats_accumulate(&local, x, one_hot, gmm);
+            one_hot[k] = 0.0;
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        stats_add(&stats, &local);
+        free(one_hot);
+        free(local_buffer);
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, stats.data, (int)stats.size, MPI_DOUBLE, MPI_SUM, options->comm);
+#endif
+
+    // the starting covariance (of the whole dataset) for empty components
+    T *fallback = (T*)malloc((size_t)dim * dim * sizeof(T));
+    memcpy(fallback, gmm_cov(gmm, 0), (size_t)dim * dim * sizeof(T));
+    stats_to_gmm(&stats, gmm, (double)total);
+    double weight_sum = 0.0;
+    for (int k = 0; k < K; k++) {
+        if (stats.resp_sum[k] == 0.0) {
+            if (gmm->cov_type != COV_TIED) // already the shared one
+                memcpy(gmm_cov(gmm, k), fallback, (size_t)dim * dim * sizeof(T));
+            gmm->weights[k] = 1.0 / total;
+        }
+        weight_sum += gmm->weights[k];
+    }
+    for (int k = 0; k < K; k++)
+        gmm->weights[k] /= weight_sum;
+
+    free(fallback);
+    free(buffer);
+    free(sums);
+    free(assign);
+    return iter;
+}
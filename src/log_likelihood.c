@@ -1,21 +1,79 @@
-#include <math.h>
+#include <tgmath.h> // expf/logf on the float32 build
 #include <stdlib.h>
 #include <stdio.h>
 #include <omp.h>
 #include "include/commons.h"
+#include "include/scratch.h"
 
-T log_likelihood(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters) {
-    T total_log_lik = 0.0;
+// Turns a row of log(weight_k * pdf_k) into normalized responsibilities
+// (log-sum-exp, no underflow) and returns log(sum_k weight_k * pdf_k)
+T log_sum_exp_normalize(T* log_resp, int num_clusters) {
+    T max_log = -INFINITY;
+    for(int k = 0; k < num_clusters; k++) {
+        if(log_resp[k] > max_log) max_log = log_resp[k];
+    }
+
+    if(max_log == -INFINITY) {
+        // no component can explain the point
+        for(int k = 0; k < num_clusters; k++) log_resp[k] = 0.0;
+        return -INFINITY;
+    }
+
+    T sum = 0.0;
+    for(int k = 0; k < num_clusters; k++) {
+        log_resp[k] = exp(log_resp[k] - max_log);
+        sum += log_resp[k];
+    }
+    for(int k = 0; k < num_clusters; k++) {
+        log_resp[k] /= sum;
+    }
+    return max_log + log(sum);
+}
 
-    #pragma omp parallel for reduction(+:total_log_lik)
-    for(int n = 0; n < num_data_points; n++) {
-        T prob = 0.0;
-        int data_offset = n * dim;
-        for(int k = 0; k < num_clusters; k++) {
-            T pdf = multiv_gaussian_pdf(&data_points[data_offset], dim, gmm[k].mean, gmm[k].cov);
-            prob += gmm[k].weight * pdf;
+// Standalone log-likelihood, the EM loop gets it from the E-step instead.
+// Needs the scratch arena (see PDF_SCRATCH_ELEMS).
+double log_likelihood(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters) {
+    double total_log_lik = 0.0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:total_log_lik)
+#endif
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        T* log_joint = (T*)scratch_alloc(scratch, POINT_BLOCK * num_clusters * sizeof(T));
+
+        log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, log_joint);
+        for(int p = 0; p < count; p++) {
+            total_log_lik += log_sum_exp_normalize(&log_joint[p * num_clusters], num_clusters);
         }
-        total_log_lik += log(prob + 1e-18);
+        scratch_release(scratch, mark);
     }
     return total_log_lik;
-}
\ No newline at end of file
+}
+
+// Most likely component of every point under the current parameters
+// (one pass, used when the responsibilities were not stored)
+void predict_labels(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        T* log_joint = (T*)scratch_alloc(scratch, POINT_BLOCK * num_clusters * sizeof(T));
+
+        log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, log_joint);
+        for(int p = 0; p < count; p++) {
+            T* row = &log_joint[p * num_clusters];
+            int max_k = 0;
+            for(int k = 1; k < num_clusters; k++) {
+                if(row[k] > row[max_k]) max_k = k;
+            }
+            labels[b + p] = max_k;
+        }
+        scratch_release(scratch, mark);
+    }
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../include/commons.h"
+#include "../include/matrix_utils.h"
+
+/* -------------------------------------------------------------
+   Cholesky decomposition: A = L * L^T (A symmetric positive definite)
+   Matrices are flat and row-major.
+   Only the lower triangle of L is written, the upper one is zeroed.
+   Dot products are accumulated in double whatever T is.
+   Returns 0 on success, -1 if A is not positive definite.
+------------------------------------------------------------- */
+int cholesky_decompose(T *A, int dim, T *L) {
+    for (int i = 0; i < dim; i++) {
+        for (int j = 0; j <= i; j++) {
+            double sum = A[i * dim + j];
+            for (int k = 0; k < j; k++)
+                sum -= L[i * dim + k] * L[j * dim + k];
+
+            if (i == j) {
+                if (sum <= 0.0)
+                    return -1; // not positive definite
+                L[i * dim + i] = sqrt(sum);
+            } else {
+                L[i * dim + j] = sum / L[j * dim + j];
+            }
+        }
+        for (int j = i + 1; j < dim; j++)
+            L[i * dim + j] = 0.0;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------
+   log(det(A)) from its Cholesky factor: 2 * sum(log(L_ii))
+------------------------------------------------------------- */
+T cholesky_log_det(T *L, int dim) {
+    double log_det = 0.0;
+    for (int i = 0; i < dim; i++)
+        log_det += log((double)L[i * dim + i]);
+    return 2.0 * log_det;
+}
+
+/* -------------------------------------------------------------
+   Squared Mahalanobis distance v^T * A^{-1} * v = ||L^{-1} v||^2
+   Solves L z = v by forward substitution, overwriting v with z.
+------------------------------------------------------------- */
+T cholesky_mahalanobis(T *L, T *v, int dim) {
+    T dist = 0.0;
+    for (int i = 0; i < dim; i++) {
+        T z = v[i];
+        for (int j = 0; j < i; j++)
+            z -= L[i * dim + j] * v[j];
+        z /= L[i * dim + i];
+        v[i] = z;
+        dist += z * z;
+    }
+    return dist;
+}
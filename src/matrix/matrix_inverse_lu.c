@@ -8,7 +8,7 @@
    LUP decomposition: A = P * L * U
    Returns 0 on success, -1 if singular.
 ------------------------------------------------------------- */
-int lu_decompose(T **A, int dim, int *P) {
+int lu_decompose(T *A, int dim, int *P) {
     for (int i = 0; i < dim; i++)
         P[i] = i;
 
@@ -18,7 +18,7 @@ int lu_decompose(T **A, int dim, int *P) {
         T maxA = 0.0f;
         int pivot = -1;
         for (int i = k; i < dim; i++) {
-            T val = fabs(A[i][k]);
+            T val = fabs(A[i * dim + k]);
             if (val > maxA) {
                 maxA = val;
                 pivot = i;
@@ -34,16 +34,18 @@ int lu_decompose(T **A, int dim, int *P) {
             P[k] = P[pivot];
             P[pivot] = tmpP;
 
-            T *tmp = A[k];
-            A[k] = A[pivot];
-            A[pivot] = tmp;
+            for (int j = 0; j < dim; j++) {
+                T tmp = A[k * dim + j];
+                A[k * dim + j] = A[pivot * dim + j];
+                A[pivot * dim + j] = tmp;
+            }
         }
 
         // Perform factorization
         for (int i = k + 1; i < dim; i++) {
-            A[i][k] /= A[k][k];
+            A[i * dim + k] /= A[k * dim + k];
             for (int j = k + 1; j < dim; j++) {
-                A[i][j] -= A[i][k] * A[k][j];
+                A[i * dim + j] -= A[i * dim + k] * A[k * dim + j];
             }
         }
     }
@@ -53,23 +55,23 @@ int lu_decompose(T **A, int dim, int *P) {
 /* -------------------------------------------------------------
    Solve LUx = b using forward + backward substitution
 ------------------------------------------------------------- */
-void lu_solve(T **LU, int dim, int *P, T *b, T *x) {
+void lu_solve(T *LU, int dim, int *P, T *b, T *x) {
     T *y = (T*)malloc(dim * sizeof(T));
 
     // Forward substitution Ly = Pb
     for (int i = 0; i < dim; i++) {
         y[i] = b[P[i]];
         for (int j = 0; j < i; j++)
-            y[i] -= LU[i][j] * y[j];
+            y[i] -= LU[i * dim + j] * y[j];
     }
 
     // Backward substitution Ux = y
     for (int i = dim - 1; i >= 0; i--) {
         x[i] = y[i];
         for (int j = i + 1; j < dim; j++)
-            x[i] -= LU[i][j] * x[j];
+            x[i] -= LU[i * dim + j] * x[j];
 
-        x[i] /= LU[i][i];
+        x[i] /= LU[i * dim + i];
     }
 
 
@@ -79,12 +81,11 @@ void lu_solve(T **LU, int dim, int *P, T *b, T *x) {
 /* -------------------------------------------------------------
    Compute inverse by solving LU * x = e_i for each i
 ------------------------------------------------------------- */
-int invert_matrix(T **matrix, int dim, T **matrix_inv) {
+int invert_matrix(T *matrix, int dim, T *matrix_inv) {
     // Copy A because LU decomposition destroys it
-    T **LU = alloc_matrix(dim, dim);
-    for (int i = 0; i < dim; i++)
-        for (int j = 0; j < dim; j++)
-            LU[i][j] = matrix[i][j];
+    T *LU = alloc_matrix(dim, dim);
+    for (int i = 0; i < dim * dim; i++)
+        LU[i] = matrix[i];
 
     int *P = (int*)malloc(dim * sizeof(int));
     if (lu_decompose(LU, dim, P) == -1) { 
@@ -104,12 +105,12 @@ int invert_matrix(T **matrix, int dim, T **matrix_inv) {
 
         // Write solution into inverse matrix
         for (int i = 0; i < dim; i++)
-            matrix_inv[i][col] = x[i];
+            matrix_inv[i * dim + col] = x[i];
     } 
 
     free(P);
     free(e);
     free(x);
-    free_matrix(LU, dim);
+    free_matrix(LU);
     return 0;
 }
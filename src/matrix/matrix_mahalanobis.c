@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/commons.h"
+#include "../include/matrix_utils.h"
+
+/* -------------------------------------------------------------
+   Runtime dispatch: GCC/Clang on x86-64 compile the kernel once per
+   instruction set and pick the widest one the CPU supports at load
+   time (ifunc). Anywhere else only the portable version is built.
+------------------------------------------------------------- */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(NO_SIMD_DISPATCH)
+#define SIMD_DISPATCH 1
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+/* -------------------------------------------------------------
+   Squared Mahalanobis distance of a block of 'count' <= POINT_BLOCK
+   consecutive points x (row-major, count x dim) to one component,
+   given the lower Cholesky factor L of its covariance.
+
+   The points are transposed into 'work' (dim x POINT_BLOCK) so the
+   forward substitution L z = x - mean runs across the block: every
+   inner loop has POINT_BLOCK independent lanes and no dependency, which
+   the compiler maps onto full AVX2/AVX-512 registers.
+   'work' must hold dim * POINT_BLOCK elements, 'dist' POINT_BLOCK.
+------------------------------------------------------------- */
+SIMD_CLONES
+void mahalanobis_block(const T *x, int count, int dim, const T *mean, const T *L, T *dist, T *work) {
+    for (int p = 0; p < POINT_BLOCK; p++)
+        dist[p] = 0.0;
+
+    for (int i = 0; i < dim; i++) {
+        T *z_i = work + i * POINT_BLOCK;
+
+        // x - mean, padding lanes are zero
+        for (int p = 0; p < count; p++)
+            z_i[p] = x[p * dim + i] - mean[i];
+        for (int p = count; p < POINT_BLOCK; p++)
+            z_i[p] = 0.0;
+
+        // z_i -= sum_{j<i} L_ij * z_j
+        const T *L_i = L + i * dim;
+        for (int j = 0; j < i; j++) {
+            const T l_ij = L_i[j];
+            const T *z_j = work + j * POINT_BLOCK;
+            for (int p = 0; p < POINT_BLOCK; p++)
+                z_i[p] -= l_ij * z_j[p];
+        }
+
+        const T inv_l_ii = 1.0 / L_i[i];
+        for (int p = 0; p < POINT_BLOCK; p++) {
+            z_i[p] *= inv_l_ii;
+            dist[p] += z_i[p] * z_i[p];
+        }
+    }
+}
+
+/* -------------------------------------------------------------
+   Kernels of the diagonal and tied covariance models, which share
+   one transposed block of points (dim x POINT_BLOCK, padding lanes
+   zero) between all the components instead of redoing it per
+   component like mahalanobis_block.
+------------------------------------------------------------- */
+void transpose_block(const T *x, int count, int dim, T *xt) {
+    for (int i = 0; i < dim; i++) {
+        T *xt_i = xt + i * POINT_BLOCK;
+        for (int p = 0; p < count; p++)
+            xt_i[p] = x[p * dim + i];
+        for (int p = count; p < POINT_BLOCK; p++)
+            xt_i[p] = 0.0;
+    }
+}
+
+// Diagonal covariance: sum_i ((x_i - mean_i) / sigma_i)^2, O(dim) per point
+SIMD_CLONES
+void diag_mahalanobis_block(const T *xt, int dim, const T *mean, const T *inv_sd, T *dist) {
+    for (int p = 0; p < POINT_BLOCK; p++)
+        dist[p] = 0.0;
+
+    for (int i = 0; i < dim; i++) {
+        const T *x_i = xt + i * POINT_BLOCK;
+        const T mean_i = mean[i], inv_sd_i = inv_sd[i];
+        for (int p = 0; p < POINT_BLOCK; p++) {
+            T z = (x_i[p] - mean_i) * inv_sd_i;
+            dist[p] += z * z;
+        }
+    }
+}
+
+// Tied covariance, step 1: z = L^-1 x in place, once per block for all the
+// components (the forward substitution of mahalanobis_block without the mean)
+SIMD_CLONES
+void whiten_block(T *xt, int dim, const T *L) {
+    for (int i = 0; i < dim; i++) {
+        T *z_i = xt + i * POINT_BLOCK;
+        const T *L_i = L + i * dim;
+        for (int j = 0; j < i; j++) {
+            const T l_ij = L_i[j];
+            const T *z_j = xt + j * POINT_BLOCK;
+            for (int p = 0; p < POINT_BLOCK; p++)
+                z_i[p] -= l_ij * z_j[p];
+        }
+        const T inv_l_ii = 1.0 / L_i[i];
+        for (int p = 0; p < POINT_BLOCK; p++)
+            z_i[p] *= inv_l_ii;
+    }
+}
+
+// Tied covariance, step 2: |z - L^-1 mean_k|^2, O(dim) per point and component
+SIMD_CLONES
+void sq_dist_block(const T *zt, int dim, const T *center, T *dist) {
+    for (int p = 0; p < POINT_BLOCK; p++)
+        dist[p] = 0.0;
+
+    for (int i = 0; i < dim; i++) {
+        const T *z_i = zt + i * POINT_BLOCK;
+        const T c_i = center[i];
+        for (int p = 0; p < POINT_BLOCK; p++) {
+            T d = z_i[p] - c_i;
+            dist[p] += d * d;
+        }
+    }
+}
+
+/* -------------------------------------------------------------
+   Name of the instruction set the kernel dispatches to
+------------------------------------------------------------- */
+const char* mahalanobis_kernel_isa(void) {
+#ifdef SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return "avx512";
+    if (__builtin_cpu_supports("avx2")) return "avx2";
+#endif
+    return "portable";
+}
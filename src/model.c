@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "include/commons.h"
+#include "include/matrix_utils.h"
+#include "include/model.h"
+
+static int write_doubles(FILE *fp, const T *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        double v = values[i];
+        if (fwrite(&v, sizeof(v), 1, fp) != 1) return -1;
+    }
+    return 0;
+}
+
+static int read_doubles(FILE *fp, T *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        double v;
+        if (fread(&v, sizeof(v), 1, fp) != 1) return -1;
+        values[i] = (T)v;
+    }
+    return 0;
+}
+
+// Written to a temporary file renamed over 'path': a job killed while
+// writing leaves the previous checkpoint intact
+int save_model(const char *path, GMM *gmm, int iteration, double log_lik) {
+    int K = gmm->num_clusters, dim = gmm->dim;
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        perror(tmp_path);
+        return -1;
+    }
+
+    ModelHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MODEL_MAGIC, 8);
+    h.endian_tag = MODEL_ENDIAN_TAG;
+    h.num_clusters = (uint32_t)K;
+    h.dim = (uint32_t)dim;
+    h.iteration = (uint32_t)iteration;
+    h.log_lik = log_lik;
+    h.cov_type = (uint32_t)gmm->cov_type;
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1 && write_doubles(fp, gmm->weights, K) == 0;
+    for (int k = 0; ok && k < K; k++)
+        ok = write_doubles(fp, gmm_mean(gmm, k), dim) == 0;
+    for (int k = 0; ok && k < K; k++)
+        ok = write_doubles(fp, gmm_cov(gmm, k), (size_t)dim * dim) == 0;
+    if (fclose(fp) != 0 || !ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "%s: write failed\n", path);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Parameters of a saved model into 'gmm', which must have its K and D. A
+// model of another covariance type is projected onto the one of 'gmm'.
+int load_model(const char *path, GMM *gmm, int *iteration, double *log_lik) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    ModelHeader h;
+    int K = gmm->num_clusters, dim = gmm->dim;
+    int ret = -1;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, MODEL_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a model file\n", path);
+    } else if (h.endian_tag != MODEL_ENDIAN_TAG) {
+        fprintf(stderr, "%s: written with a different byte order\n", path);
+    } else if (h.num_clusters != (uint32_t)K || h.dim != (uint32_t)dim) {
+        fprintf(stderr, "%s: model of %u clusters in %u dimensions, expected %d and %d\n",
+                path, h.num_clusters, h.dim, K, dim);
+    } else {
+        int ok = read_doubles(fp, gmm->weights, K) == 0;
+        for (int k = 0; ok && k < K; k++)
+            ok = read_doubles(fp, gmm_mean(gmm, k), dim) == 0;
+        for (int k = 0; ok && k < K; k++)
+            ok = read_doubles(fp, gmm_cov(gmm, k), (size_t)dim * dim) == 0;
+        if (ok && h.cov_type != (uint32_t)gmm->cov_type) {
+            printf("[DEBUG] %s: %s covariances, projected onto %s ones\n",
+                   path, cov_type_name((int)h.cov_type), cov_type_name(gmm->cov_type));
+            constrain_covariances(gmm);
+        }
+        if (ok) {
+            *iteration = (int)h.iteration;
+            *log_lik = h.log_lik;
+            ret = 0;
+        } else {
+            fprintf(stderr, "%s: truncated file\n", path);
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+// Starting parameters from --resume (a checkpoint, with the iteration and
+// log-likelihood to continue from, stored in 'options') or --init-model
+// (a saved model, EM restarts from iteration 0). Returns 1 if 'gmm' was
+// loaded, 0 if init_gmm is needed, -1 on error. A missing checkpoint is not
+// an error: the first run of a job script resumed after preemption.
+int load_start_model(GMM *gmm, EMOptions *options) {
+    int iteration;
+    double log_lik;
+
+    if (options->resume_path[0]) {
+        FILE *fp = fopen(options->resume_path, "rb");
+        if (!fp && errno == ENOENT) {
+            printf("[DEBUG] No checkpoint at %s, starting from scratch\n", options->resume_path);
+            return 0;
+        }
+        if (fp) fclose(fp);
+        if (load_model(options->resume_path, gmm, &iteration, &log_lik) != 0) return -1;
+
+        // at least one more iteration, whose E-step also yields the labels
+        options->start_iter = iteration < MAX_ITER ? iteration : MAX_ITER - 1;
+        options->start_log_lik = log_lik;
+        printf("[DEBUG] Resuming from %s at iteration %d\n", options->resume_path, options->start_iter + 1);
+        return 1;
+    }
+    if (options->init_model[0]) {
+        if (load_model(options->init_model, gmm, &iteration, &log_lik) != 0) return -1;
+        printf("[DEBUG] Warm start from %s\n", options->init_model);
+        return 1;
+    }
+    return 0;
+}
+
+// Called by the EM loops once 'next_iter' iterations are done: saves the
+// state every checkpoint_every iterations, or now if 'force'
+void checkpoint_em(const EMOptions *options, GMM *gmm, int next_iter, double prev_log_lik, int force) {
+    if (!options->checkpoint_path[0]) return;
+    if (force || next_iter % options->checkpoint_every == 0)
+        save_model(options->checkpoint_path, gmm, next_iter, prev_log_lik);
+}
+
+// K, D and covariance type of a saved model, to allocate it before load_model
+int model_info(const char *path, int *num_clusters, int *dim, int *cov_type) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    ModelHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, MODEL_MAGIC, 8) == 0;
+    fclose(fp);
+    if (!ok || h.endian_tag != MODEL_ENDIAN_TAG || h.num_clusters == 0 || h.dim == 0 || h.cov_type > COV_TIED) {
+        fprintf(stderr, "%s: not a model file (or a different byte order)\n", path);
+        return -1;
+    }
+    *num_clusters = (int)h.num_clusters;
+    *dim = (int)h.dim;
+    *cov_type = (int)h.cov_type;
+    return 0;
+}
+
+static void json_matrix(FILE *fp, const T *m, int dim) {
+    fprintf(fp, "[");
+    for (int i = 0; i < dim; i++) {
+        fprintf(fp, "%s[", i ? ", " : "");
+        for (int j = 0; j < dim; j++)
+            fprintf(fp, "%s%.17g", j ? ", " : "", (double)m[i * dim + j]);
+        fprintf(fp, "]");
+    }
+    fprintf(fp, "]");
+}
+
+// Inverse of cov = L L^T, column by column: L y = e_j, then L^T x = y
+static int precision_matrix(T *cov, int dim, T *L, T *precision) {
+    if (cholesky_decompose(cov, dim, L) != 0) return -1;
+    for (int j = 0; j < dim; j++) {
+        T *x = &precision[j * dim]; // row j = column j, the inverse is symmetric
+        for (int i = 0; i < dim; i++) {
+            double sum = (i == j) ? 1.0 : 0.0;
+            for (int p = 0; p < i; p++) sum -= L[i * dim + p] * x[p];
+            x[i] = sum / L[i * dim + i];
+        }
+        for (int i = dim - 1; i >= 0; i--) {
+            double sum = x[i];
+            for (int p = i + 1; p < dim; p++) sum -= L[p * dim + i] * x[p];
+            x[i] = sum / L[i * dim + i];
+        }
+    }
+    return 0;
+}
+
+// Weights, means, covariances and their inverses (precisions) as JSON
+int save_model_json(const char *path, GMM *gmm) {
+    int K = gmm->num_clusters, dim = gmm->dim;
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    T *precision = alloc_matrix(dim, dim);
+    T *L = alloc_matrix(dim, dim);
+
+    fprintf(fp, "{\n  \"num_clusters\": %d,\n  \"dim\": %d,\n  \"covariance_type\": \"%s\",\n  \"weights\": [",
+            K, dim, cov_type_name(gmm->cov_type));
+    for (int k = 0; k < K; k++)
+        fprintf(fp, "%s%.17g", k ? ", " : "", (double)gmm->weights[k]);
+    fprintf(fp, "],\n  \"means\": [");
+    for (int k = 0; k < K; k++) {
+        fprintf(fp, "%s\n    [", k ? "," : "");
+        for (int d = 0; d < dim; d++)
+            fprintf(fp, "%s%.17g", d ? ", " : "", (double)gmm_mean(gmm, k)[d]);
+        fprintf(fp, "]");
+    }
+    fprintf(fp, "\n  ],\n  \"covariances\": [");
+    for (int k = 0; k < K; k++) {
+        fprintf(fp, "%s\n    ", k ? "," : "");
+        json_matrix(fp, gmm_cov(gmm, k), dim);
+    }
+    fprintf(fp, "\n  ],\n  \"precisions\": [");
+    for (int k = 0; k < K; k++) {
+        fprintf(fp, "%s\n    ", k ? "," : "");
+        if (precision_matrix(gmm_cov(gmm, k), dim, L, precision) == 0)
+            json_matrix(fp, precision, dim);
+        else
+            fprintf(fp, "null"); // not positive definite
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    free_matrix(precision);
+    free_matrix(L);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// --save-model: JSON for a ".json" path, the binary model file otherwise
+int export_model(const char *path, GMM *gmm) {
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+        return save_model_json(path, gmm);
+    return save_model(path, gmm, 0, -INFINITY);
+}
@@ -0,0 +1,62 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "include/commons.h"
+#include "include/init.h"
+#include "include/restarts.h"
+#include "include/model_selection.h"
+
+GMM* select_num_clusters(T* data_points, int dim, int num_data_points, int k_min, int* labels, EMOptions* options) {
+    int rank = 0;
+    long long total_points = num_data_points;
+#ifdef USE_MPI
+    MPI_Comm_rank(options->comm, &rank);
+    MPI_Allreduce(MPI_IN_PLACE, &total_points, 1, MPI_LONG_LONG, MPI_SUM, options->comm);
+#endif
+
+    // the labels buffer of the fits is shared, the best ones are copied out
+    int *run_labels = (int*)malloc(((size_t)num_data_points + 1) * sizeof(int));
+    GMM *best = NULL;
+    double best_score = INFINITY;
+    EMOptions run = *options;
+
+    for (int K = k_min; K <= options->k_max; K++) {
+        GMM *gmm = alloc_gmm(K, dim, options->cov_type);
+        double log_lik;
+        if (options->n_init > 1) {
+            log_lik = fit_restarts(data_points, dim, num_data_points, gmm, K, run_labels, &run);
+        } else {
+            init_gmm(gmm, K, dim, data_points, num_data_points, &run);
+#ifdef USE_MPI
+            MPI_Bcast(gmm->block, (int)gmm->block_size, MPI_BYTE, 0, options->comm);
+#endif
+            log_lik = em_algorithm(data_points, dim, num_data_points, gmm, K, run_labels, &run);
+        }
+
+        double params = GMM_NUM_PARAMS(K, dim, options->cov_type);
+        double bic = -2.0 * log_lik + params * log((double)total_points);
+        double aic = -2.0 * log_lik + 2.0 * params;
+        double score = options->criterion == CRITERION_AIC ? aic : bic;
+        if (rank == 0)
+            printf("[DEBUG] K = %d: log-likelihood %.6f, BIC %.3f, AIC %.3f\n", K, log_lik, bic, aic);
+
+        if (!best || score < best_score) {
+            free_gmm(best);
+            best = gmm;
+            best_score = score;
+            memcpy(labels, run_labels, (size_t)num_data_points * sizeof(int));
+        } else {
+            free_gmm(gmm);
+        }
+    }
+
+    if (rank == 0)
+        printf("[DEBUG] Best K by %s: %d\n", options->criterion == CRITERION_AIC ? "AIC" : "BIC", best->num_clusters);
+    free(run_labels);
+    return best;
+}
@@ -1,41 +1,242 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/commons.h"
 #include "include/matrix_utils.h"
+#include "include/scratch.h"
 
-// Multivariate Gaussian Probability of a single data point
-T multiv_gaussian_pdf(T* x, int dim, T* means, T** cov_matrix) {
-    // (x - mean)
-    T* x_mu = malloc(dim * sizeof(T));
+#define GMM_ALIGN 64
+
+// Round a number of T elements up to a whole number of cache lines
+static size_t pad_elems(size_t n) {
+    size_t per_line = GMM_ALIGN / sizeof(T);
+    return (n + per_line - 1) / per_line * per_line;
+}
+
+// Allocate a model with all its arrays carved out of one aligned block
+GMM* alloc_gmm(int num_clusters, int dim, int cov_type) {
+    GMM* gmm = (GMM*)malloc(sizeof(GMM));
+    gmm->num_clusters = num_clusters;
+    gmm->dim = dim;
+    gmm->cov_type = cov_type;
+    gmm->vec_stride = (int)pad_elems(dim);
+    gmm->mat_stride = (int)pad_elems((size_t)dim * dim);
+
+    size_t k_elems = pad_elems(num_clusters);
+    size_t vec_elems = (size_t)num_clusters * gmm->vec_stride;
+    size_t mat_elems = (size_t)num_clusters * gmm->mat_stride;
+    gmm->block_size = (6 * k_elems + 2 * vec_elems + 2 * mat_elems) * sizeof(T);
+
+    if (posix_memalign(&gmm->block, GMM_ALIGN, gmm->block_size) != 0) {
+        free(gmm);
+        return NULL;
+    }
+    memset(gmm->block, 0, gmm->block_size);
+
+    // Model parameters first, so they form one contiguous prefix of the block
+    T* p = (T*)gmm->block;
+    gmm->weights = p;      p += k_elems;
+    gmm->means = p;        p += vec_elems;
+    gmm->covs = p;         p += mat_elems;
+    gmm->class_resp = p;   p += k_elems;
+    gmm->chols = p;        p += mat_elems;
+    gmm->prec_vecs = p;    p += vec_elems;
+    gmm->log_dets = p;     p += k_elems;
+    gmm->log_weights = p;  p += k_elems;
+    gmm->log_norms = p;
+    return gmm;
+}
+
+void free_gmm(GMM* gmm) {
+    if (!gmm) return;
+    free(gmm->block);
+    free(gmm);
+}
+
+int parse_cov_type(const char* name, int* cov_type) {
+    if (strcmp(name, "full") == 0) *cov_type = COV_FULL;
+    else if (strcmp(name, "diag") == 0) *cov_type = COV_DIAG;
+    else if (strcmp(name, "spherical") == 0) *cov_type = COV_SPHERICAL;
+    else if (strcmp(name, "tied") == 0) *cov_type = COV_TIED;
+    else return -1;
+    return 0;
+}
+
+const char* cov_type_name(int cov_type) {
+    switch (cov_type) {
+    case COV_DIAG: return "diag";
+    case COV_SPHERICAL: return "spherical";
+    case COV_TIED: return "tied";
+    default: return "full";
+    }
+}
+
+// Project the covariances onto the form of gmm->cov_type: off-diagonal
+// terms dropped (diag), the mean variance on the diagonal (spherical) or
+// the weighted average of all components (tied, the pooled within-cluster
+// covariance). Maximum likelihood within that form given the full ones.
+void constrain_covariances(GMM* gmm) {
+    int K = gmm->num_clusters, dim = gmm->dim;
+
+    if (gmm->cov_type == COV_DIAG || gmm->cov_type == COV_SPHERICAL) {
+        for (int k = 0; k < K; k++) {
+            T* cov = gmm_cov(gmm, k);
+            double trace = 0.0;
+            for (int i = 0; i < dim; i++) trace += cov[i * dim + i];
+            for (int i = 0; i < dim; i++)
+                for (int j = 0; j < dim; j++)
+                    if (i != j) cov[i * dim + j] = 0.0;
+            if (gmm->cov_type == COV_SPHERICAL)
+                for (int i = 0; i < dim; i++) cov[i * dim + i] = trace / dim;
+        }
+    } else if (gmm->cov_type == COV_TIED) {
+        double weight_sum = 0.0;
+        for (int k = 0; k < K; k++) weight_sum += gmm->weights[k];
+        T* shared = gmm_cov(gmm, 0);
+        for (int i = 0; i < dim * dim; i++) {
+            double sum = 0.0;
+            for (int k = 0; k < K; k++) sum += gmm->weights[k] * gmm_cov(gmm, k)[i];
+            shared[i] = sum / weight_sum;
+        }
+        for (int k = 1; k < K; k++)
+            memcpy(gmm_cov(gmm, k), shared, (size_t)dim * dim * sizeof(T));
+    }
+}
+
+static void mark_degenerate(GMM* gmm, int k) {
+    printf("Covariance matrix of cluster %d is not positive definite.\n", k);
+    gmm->log_dets[k] = INFINITY;
+    gmm->log_norms[k] = -INFINITY;
+}
+
+// Factorize every covariance once per iteration so that the E-step only
+// needs a triangular solve per point instead of an inverse and a determinant.
+// Diagonal forms only need 1 / sigma per feature; the tied one is factorized
+// once and the means whitened with it, so that a point is whitened once for
+// all components (see log_joint_block).
+void precompute_gaussians(GMM* gmm, int num_clusters, int dim) {
+    int tied_ok = 1;
+    if (gmm->cov_type == COV_TIED)
+        tied_ok = cholesky_decompose(gmm_cov(gmm, 0), dim, gmm_chol(gmm, 0)) == 0;
+
+    for (int k = 0; k < num_clusters; k++) {
+        gmm->log_weights[k] = log(gmm->weights[k]);
+        T* cov = gmm_cov(gmm, k);
+        T* prec = gmm->prec_vecs + (size_t)k * gmm->vec_stride;
+
+        switch (gmm->cov_type) {
+        case COV_DIAG:
+        case COV_SPHERICAL: {
+            double log_det = 0.0;
+            int i;
+            for (i = 0; i < dim && cov[i * dim + i] > 0.0; i++) {
+                log_det += log(cov[i * dim + i]);
+                prec[i] = 1.0 / sqrt(cov[i * dim + i]);
+            }
+            if (i < dim) {
+                mark_degenerate(gmm, k);
+                continue;
+            }
+            gmm->log_dets[k] = log_det;
+            break;
+        }
+        case COV_TIED: {
+            if (!tied_ok) {
+                mark_degenerate(gmm, k);
+                continue;
+            }
+            // L m_k = mean_k
+            const T* L = gmm_chol(gmm, 0);
+            const T* mean = gmm_mean(gmm, k);
+            for (int i = 0; i < dim; i++) {
+                double sum = mean[i];
+                for (int j = 0; j < i; j++) sum -= L[i * dim + j] * prec[j];
+                prec[i] = sum / L[i * dim + i];
+            }
+            gmm->log_dets[k] = cholesky_log_det(gmm_chol(gmm, 0), dim);
+            break;
+        }
+        default:
+            if (cholesky_decompose(cov, dim, gmm_chol(gmm, k)) != 0) {
+                // not positive definite: the component gets zero density
+                mark_degenerate(gmm, k);
+                continue;
+            }
+            gmm->log_dets[k] = cholesky_log_det(gmm_chol(gmm, k), dim);
+        }
+        gmm->log_norms[k] = -0.5 * (dim * log(2 * PI) + gmm->log_dets[k]);
+    }
+}
+
+// Log of the multivariate Gaussian density of a single data point
+T log_multiv_gaussian_pdf(T* x, int dim, GMM* gmm, int k) {
+    if (gmm->log_norms[k] == -INFINITY)
+        return -INFINITY;
+
+    // (x - mean), taken from the calling thread's scratch arena
+    Scratch* scratch = thread_scratch();
+    size_t mark = scratch_mark(scratch);
+    T* x_mu = (T*)scratch_alloc(scratch, dim * sizeof(T));
+    T* mean = gmm_mean(gmm, k);
     for (int i = 0; i < dim; i++) {
-        x_mu[i] = x[i] - means[i];
+        x_mu[i] = x[i] - mean[i];
     }
 
-    // (cov_matrix)^(-1)
-    T** inv_cov_matrix = alloc_matrix(dim, dim);
-    if (invert_matrix(cov_matrix, dim, inv_cov_matrix) != 0) {
-        // singlular matrix, non invertible
-        printf("Covariance matrix is singular, cannot compute its inverse.\n");
-        free(x_mu);
-        free_matrix(inv_cov_matrix, dim);
-        return 0.0;
+    // (x - mean)^T * (cov_matrix)^(-1) * (x - mean) via L^(-1) * (x - mean)
+    T dot = 0.0;
+    if (gmm->cov_type == COV_DIAG || gmm->cov_type == COV_SPHERICAL) {
+        const T* inv_sd = gmm->prec_vecs + (size_t)k * gmm->vec_stride;
+        for (int i = 0; i < dim; i++) {
+            T z = x_mu[i] * inv_sd[i];
+            dot += z * z;
+        }
+    } else {
+        dot = cholesky_mahalanobis(gmm_chol(gmm, gmm->cov_type == COV_TIED ? 0 : k), x_mu, dim);
     }
+    scratch_release(scratch, mark);
+
+    return gmm->log_norms[k] - 0.5 * dot;
+}
+
+// log(weight_k) + log N(x_p | k) for a block of 'count' <= POINT_BLOCK
+// consecutive points, written row-major (count x num_clusters)
+void log_joint_block(const T* x, int count, int dim, GMM* gmm, int num_clusters, T* log_joint) {
+    Scratch* scratch = thread_scratch();
+    size_t mark = scratch_mark(scratch);
+    T* work = (T*)scratch_alloc(scratch, (size_t)dim * POINT_BLOCK * sizeof(T));
+    T* dist = (T*)scratch_alloc(scratch, POINT_BLOCK * sizeof(T));
 
-    // (x - mean)^T * (cov_matrix)^(-1)
-    T* x_mu_by_inv_cov = malloc(dim * sizeof(T));
-    mat_vec_mult(inv_cov_matrix, x_mu, x_mu_by_inv_cov, dim);
+    // the diagonal and tied kernels share the transposed (and, tied, whitened)
+    // block between all components
+    if (gmm->cov_type != COV_FULL) {
+        transpose_block(x, count, dim, work);
+        if (gmm->cov_type == COV_TIED && gmm->log_norms[0] != -INFINITY)
+            whiten_block(work, dim, gmm_chol(gmm, 0));
+    }
 
-    // dotProduct of the above with (x - mean)
-    T dot = dot_product(x_mu_by_inv_cov, x_mu, dim);
-    free(x_mu);
-    free(x_mu_by_inv_cov);
+    for (int k = 0; k < num_clusters; k++) {
+        if (gmm->log_norms[k] == -INFINITY) {
+            for (int p = 0; p < count; p++)
+                log_joint[p * num_clusters + k] = -INFINITY;
+            continue;
+        }
+        const T* prec = gmm->prec_vecs + (size_t)k * gmm->vec_stride;
+        if (gmm->cov_type == COV_FULL)
+            mahalanobis_block(x, count, dim, gmm_mean(gmm, k), gmm_chol(gmm, k), dist, work);
+        else if (gmm->cov_type == COV_TIED)
+            sq_dist_block(work, dim, prec, dist);
+        else
+            diag_mahalanobis_block(work, dim, gmm_mean(gmm, k), prec, dist);
 
-    T exp_res = exp(-0.5 * dot); // e^(-0.5 * dot))
-    T det = determinant(cov_matrix, dim); // det(cov_matrix)
-    T norm_const =1 / sqrt(pow(2 * PI, dim) * det); // normalization constant
-    T p = norm_const * exp_res;
+        T log_const = gmm->log_weights[k] + gmm->log_norms[k];
+        for (int p = 0; p < count; p++)
+            log_joint[p * num_clusters + k] = log_const - 0.5 * dist[p];
+    }
+    scratch_release(scratch, mark);
+}
 
-    free_matrix(inv_cov_matrix, dim);
-    return p;
-}
\ No newline at end of file
+// Multivariate Gaussian Probability of a single data point
+T multiv_gaussian_pdf(T* x, int dim, GMM* gmm, int k) {
+    return exp(log_multiv_gaussian_pdf(x, dim, gmm, k));
+}
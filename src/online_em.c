@@ -0,0 +1,192 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "include/commons.h"
+#include "include/dataset.h"
+#include "include/scratch.h"
+#include "include/suff_stats.h"
+#include "include/utils.h"
+#include "include/init.h"
+#include "include/online_em.h"
+#include "include/results.h"
+
+/* -------------------------------------------------------------
+   Online (stepwise) EM, for datasets that do not fit in memory
+
+   The dataset is read one chunk of about options->online points at a
+   time (see DatasetChunks), so memory is bounded by the chunk size.
+   Every chunk is a mini-batch: its E-step statistics are blended into
+   the model with step size
+
+       eta_t = (t + lr_offset)^-lr_decay,   0.5 < lr_decay <= 1
+
+   (stats_step_gmm), the schedule of the stepwise EM of Cappe and
+   Moulines. An epoch is one pass over all the chunks, in a random order
+   (from --seed) so that a sorted file does not bias the model.
+
+   The same file builds into every executable: with USE_MPI process p
+   reads chunk r * size + p in round r, a round is a contiguous piece of
+   the file, and the statistics of the round's chunks are summed with one
+   allreduce per step. The results (-o) are written by a last pass over
+   the chunks in file order.
+------------------------------------------------------------- */
+
+// Chunk 'chunk' of the dataset, left empty past the last one
+static void load_chunk(const DatasetChunks *chunks, int chunk, Dataset *ds) {
+    memset(ds, 0, sizeof(*ds));
+    if (chunk >= chunks->num_chunks) return;
+    if (dataset_chunk_load(chunks, chunk, ds) != 0) {
+#ifdef USE_MPI
+        MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+        exit(1);
+    }
+}
+
+// E-step statistics of a mini-batch (of all the processes' chunks),
+// per-thread buffers merged once per thread as in the OpenMP build
+static void batch_stats(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, SuffStats* stats) {
+    stats_zero(stats);
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        SuffStats thread_stats;
+        stats_init_scratch(&thread_stats, num_clusters, dim, scratch);
+        stats_zero(&thread_stats);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+            int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+            stats_accumulate_block(&thread_stats, &data_points[b * dim], count, gmm);
+        }
+
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        stats_add(stats, &thread_stats);
+
+        scratch_release(scratch, mark);
+    }
+
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, stats->data, (int)stats->size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+}
+
+// Result file of every point, written chunk by chunk in file order
+static int write_results_online(const char *output_path, const EMOptions *options, const DatasetChunks *chunks,
+                                int num_rounds, int rank, int size, GMM* gmm, int num_clusters) {
+    int columns = options->output_columns == RESULTS_DEFAULT ? RESULTS_POINTS : options->output_columns;
+    ResultsWriter w;
+    if (results_open(&w, output_path, columns, options->output_binary, results_num_values(columns, gmm)) != 0) return -1;
+
+    int ret = 0;
+    for (int r = 0; r < num_rounds && ret == 0; r++) {
+        Dataset ds;
+        load_chunk(chunks, r * size + rank, &ds);
+        int *labels = (int*)malloc(((size_t)ds.num_points + 1) * sizeof(int));
+        if (columns != RESULTS_RESP)
+            predict_labels(ds.data, gmm->dim, ds.num_points, gmm, num_clusters, labels);
+        ret = results_write_points(&w, ds.data, ds.num_points, gmm, labels);
+        free(labels);
+        free_dataset(&ds);
+    }
+
+    if (results_close(&w) != 0) ret = -1;
+    return ret;
+}
+
+GMM* online_em(const char *dataset_path, const char *output_path, int num_clusters,
+               EMOptions *options, long long *num_points) {
+    int rank = 0, size = 1;
+#ifdef USE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+
+    DatasetChunks chunks;
+    if (dataset_chunks_open(dataset_path, options->online, &chunks) != 0) return NULL;
+    int num_rounds = (chunks.num_chunks + size - 1) / size;
+    if (rank == 0)
+        printf("[DEBUG] Online EM: %d chunks of %s%d points, %d epoch(s)\n", chunks.num_chunks,
+               chunks.binary ? "" : "~", options->online, options->epochs);
+
+    // initialization on the first round of chunks
+    Dataset ds;
+    load_chunk(&chunks, rank, &ds);
+    int dim = ds.dim;
+#ifdef USE_MPI
+    MPI_Bcast(&dim, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+    GMM *gmm = alloc_gmm(num_clusters, dim, options->cov_type);
+    init_gmm(gmm, num_clusters, dim, ds.data, ds.num_points, options);
+#ifdef USE_MPI
+    MPI_Bcast(gmm->block, (int)gmm->block_size, MPI_BYTE, 0, MPI_COMM_WORLD);
+#endif
+    free_dataset(&ds);
+
+    // E-step kernel buffers and per-thread statistics, plus the mini-batch statistics
+    scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(dim, num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS)
+                  + SCRATCH_BYTES(2 * STATS_ELEMS(num_clusters, dim), sizeof(double), 2));
+    precompute_gaussians(gmm, num_clusters, dim);
+    SuffStats batch;
+    stats_init_scratch(&batch, num_clusters, dim, thread_scratch());
+
+    int *order = (int*)malloc(num_rounds * sizeof(int));
+    unsigned int shuffle_state = options->seed;
+    long long step = 0, epoch_points = 0;
+    double log_lik = -INFINITY;
+
+    for (int epoch = 0; epoch < options->epochs; epoch++) {
+        // same shuffle on every process
+        for (int r = 0; r < num_rounds; r++) order[r] = r;
+        for (int r = num_rounds - 1; r > 0; r--) {
+            int j = rand_r(&shuffle_state) % (r + 1);
+            int tmp = order[r]; order[r] = order[j]; order[j] = tmp;
+        }
+
+        log_lik = 0.0;
+        epoch_points = 0;
+        for (int r = 0; r < num_rounds; r++) {
+            load_chunk(&chunks, order[r] * size + rank, &ds);
+            batch_stats(ds.data, dim, ds.num_points, gmm, num_clusters, &batch);
+            epoch_points += ds.num_points;
+            free_dataset(&ds);
+
+            // log-likelihood of every mini-batch under the parameters it was seen with
+            log_lik += *batch.log_lik;
+
+            double eta = pow((double)step + options->lr_offset, -options->lr_decay);
+            stats_step_gmm(&batch, gmm, eta);
+            precompute_gaussians(gmm, num_clusters, dim);
+            step++;
+        }
+        if (rank == 0)
+            printf("[DEBUG] Epoch %d: log-likelihood %.6f, step size %.4f\n", epoch + 1, log_lik,
+                   pow((double)step - 1 + options->lr_offset, -options->lr_decay));
+    }
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &epoch_points, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif
+    if (rank == 0) printf("[DEBUG] Final log-likelihood: %.6f\n", log_lik);
+    *num_points = epoch_points;
+
+    if (output_path && write_results_online(output_path, options, &chunks, num_rounds, rank, size, gmm, num_clusters) != 0
+        && rank == 0)
+        fprintf(stderr, "%s: results not written\n", output_path);
+
+    free(order);
+    scratch_teardown();
+    return gmm;
+}
@@ -5,144 +5,157 @@
 
 #include "../include/matrix_utils.h"
 #include "../include/commons.h"
-
-// E-Step: computes responsibilities for local data points
-void e_step(T** data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T** resp) {
-    // Reset local responsibilities
-    for(int k = 0; k < num_clusters; k++){
-        gmm[k].class_resp = 0.0;
-    }
-
-    for(int i = 0; i < num_data_points; i++){ 
-        T norm = 0.0;
-        // calculate unnormalized responsibility
-        for(int k = 0; k < num_clusters; k++){
-            T pdf = multiv_gaussian_pdf(data_points[i], dim, gmm[k].mean, gmm[k].cov); 
-            resp[i][k] = gmm[k].weight * pdf;
-            norm += resp[i][k];
-        }
-
-        // normalize responsibility
-        for(int k = 0; k < num_clusters; k++){ 
-            resp[i][k] /= norm;
-            gmm[k].class_resp += resp[i][k]; // accumulate local class responsibility
-        }
-    }
-}
-
-// M-Step: updates GMM parameters using distributed data
-void m_step(T** data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T** resp, int total_N) {
-    
-    // update weights and means
-    double *local_sum_resp = (double*)calloc(num_clusters, sizeof(double));
-    double *global_sum_resp = (double*)malloc(num_clusters * sizeof(double));
-    
-    double *local_sum_means = (double*)calloc(num_clusters * dim, sizeof(double));
-    double *global_sum_means = (double*)malloc(num_clusters * dim * sizeof(double));
-
-    // calculate local partial sums
-    for(int k = 0; k < num_clusters; k++){
-        local_sum_resp[k] = gmm[k].class_resp;
-        for (int i = 0; i < num_data_points; i++){
-            for(int d = 0; d < dim; d++) {
-                local_sum_means[k*dim + d] += resp[i][k] * data_points[i][d];
+#include "../include/scratch.h"
+#include "../include/suff_stats.h"
+#include "../include/model.h"
+
+// E-Step: computes log-space responsibilities for local data points and
+// folds them straight into the local M-step statistics (log-likelihood included).
+// In the hybrid build the threads accumulate private statistics, merged
+// once per thread, so the process still contributes one buffer to the reduction.
+void e_step(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, T* resp, SuffStats* local_stats) {
+    stats_zero(local_stats);
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        SuffStats thread_stats;
+        stats_init_scratch(&thread_stats, num_clusters, dim, scratch);
+        stats_zero(&thread_stats);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(int b = 0; b < num_data_points; b += POINT_BLOCK){ 
+            int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+
+            // calculate log(weight * pdf) for a block of points
+            log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, &resp[b * num_clusters]);
+
+            // normalize responsibility (log-sum-exp), accumulate while the row is in cache
+            for(int i = b; i < b + count; i++){
+                *thread_stats.log_lik += log_sum_exp_normalize(&resp[i * num_clusters], num_clusters);
+                stats_accumulate(&thread_stats, &data_points[i * dim], &resp[i * num_clusters], gmm);
             }
         }
-    }
 
-    // global reduction: sum partial results from all processes
-    MPI_Allreduce(local_sum_resp, global_sum_resp, num_clusters, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(local_sum_means, global_sum_means, num_clusters * dim, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-
-    // update GMM parameters with global values
-    for(int k = 0; k < num_clusters; k++){
-        gmm[k].class_resp = global_sum_resp[k]; // store for next step
-        gmm[k].weight = global_sum_resp[k] / total_N;
-        
-        for(int d = 0; d < dim; d++) {
-            gmm[k].mean[d] = global_sum_means[k*dim + d] / global_sum_resp[k];
-        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        stats_add(local_stats, &thread_stats);
+
+        scratch_release(scratch, mark);
     }
+}
 
-    // update covariance matrices (using new means)
-    double *local_sum_cov = (double*)calloc(num_clusters * dim * dim, sizeof(double));
-    double *global_sum_cov = (double*)malloc(num_clusters * dim * dim * sizeof(double));
-
-    for(int k = 0; k < num_clusters; k++){
-        for(int n = 0; n < num_data_points; n++){
-            for(int i = 0; i < dim; i++){
-                double diff_i = data_points[n][i] - gmm[k].mean[i];
-                for(int j = 0; j < dim; j++){
-                    double diff_j = data_points[n][j] - gmm[k].mean[j];
-                    local_sum_cov[k*dim*dim + i*dim + j] += resp[n][k] * diff_i * diff_j;
-                }
-            }
+// Streaming E-step on the local points: responsibilities go straight into
+// the local M-step statistics (log-likelihood included)
+void e_step_streaming(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, SuffStats* local_stats) {
+    stats_zero(local_stats);
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        SuffStats thread_stats;
+        stats_init_scratch(&thread_stats, num_clusters, dim, scratch);
+        stats_zero(&thread_stats);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(int b = 0; b < num_data_points; b += POINT_BLOCK){
+            int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+            stats_accumulate_block(&thread_stats, &data_points[b * dim], count, gmm);
         }
-    }
 
-    // global reduction for covariances
-    MPI_Allreduce(local_sum_cov, global_sum_cov, num_clusters * dim * dim, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        stats_add(local_stats, &thread_stats);
 
-    for(int k = 0; k < num_clusters; k++){
-        for(int i = 0; i < dim; i++){
-            for(int j = 0; j < dim; j++){
-                gmm[k].cov[i][j] = global_sum_cov[k*dim*dim + i*dim + j] / gmm[k].class_resp;
-            }
-            gmm[k].cov[i][i] += 1e-6; // regularization to avoid singular matrix
-        }
+        scratch_release(scratch, mark);
     }
-
-    // free temporary buffers
-    free(local_sum_resp); free(global_sum_resp);
-    free(local_sum_means); free(global_sum_means);
-    free(local_sum_cov); free(global_sum_cov);
 }
 
-void em_algorithm(T** data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, int* labels) {
-    int rank, size, total_N;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+double em_algorithm(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels, EMOptions* options) {
+    int rank, total_N;
+    MPI_Comm_rank(options->comm, &rank);
     
-    // calculate total N (assuming equal distribution as specified in main.c)
-    MPI_Allreduce(&num_data_points, &total_N, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-
-    T** resp = alloc_matrix(num_data_points, num_clusters); // local responsibility matrix
-    T prev_log_likelihood = -INFINITY;
-
-    for(int iter = 0; iter < MAX_ITER; iter++){
-
-        e_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
-
-        m_step(data_points, dim, num_data_points, gmm, num_clusters, resp, total_N);
-
-        // calculate distributed log-likelihood
-        double local_log_lik = log_likelihood(data_points, dim, num_data_points, gmm, num_clusters);
-        double global_log_lik = 0.0;
-        MPI_Allreduce(&local_log_lik, &global_log_lik, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-
-        if(rank == 0) {
-            if(fabs(global_log_lik - prev_log_likelihood) < EPSILON){
+    // calculate total N (the processes may hold different numbers of points)
+    MPI_Allreduce(&num_data_points, &total_N, 1, MPI_INT, MPI_SUM, options->comm);
+
+    // local responsibility matrix, never materialized in streaming mode
+    T* resp = options->streaming ? NULL : alloc_matrix(num_data_points, num_clusters);
+    double prev_log_likelihood = options->start_log_lik; // -INFINITY unless resuming
+
+    // E-step kernel buffers and the per-thread statistics come from the scratch arenas,
+    // plus the local/global statistics of the process (in the master thread's arena)
+    scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(dim, num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS)
+                  + SCRATCH_BYTES(3 * STATS_ELEMS(num_clusters, dim), sizeof(double), 3));
+    precompute_gaussians(gmm, num_clusters, dim);
+
+    // sufficient statistics (packed covariance triangles) and log-likelihood in one buffer
+    SuffStats local_stats, stats;
+    stats_init_scratch(&local_stats, num_clusters, dim, thread_scratch());
+    stats_init_scratch(&stats, num_clusters, dim, thread_scratch());
+
+    ALLOC_CHECK_DEF()
+    for(int iter = options->start_iter; iter < options->max_iter; iter++){
+        ALLOC_CHECK_START(iter)
+
+        // local statistics of the current parameters
+        if (options->streaming)
+            e_step_streaming(data_points, dim, num_data_points, gmm, num_clusters, &local_stats);
+        else
+            e_step(data_points, dim, num_data_points, gmm, num_clusters, resp, &local_stats);
+
+        // the only collective of the iteration: M-step sums and log-likelihood of all processes
+        MPI_Allreduce(local_stats.data, stats.data, (int)stats.size, MPI_DOUBLE, MPI_SUM, options->comm);
+        double global_log_lik = *stats.log_lik;
+
+        // every process gets the same reduced log-likelihood, hence the same stop decision
+        if(LOG_LIK_CONVERGED(global_log_lik, prev_log_likelihood, total_N)){
+            if(rank == 0) {
                 printf("[DEBUG] Convergence reached at iteration %d.\n", iter + 1);
+                checkpoint_em(options, gmm, iter, prev_log_likelihood, 1);
             }
+            break;
         }
-        
-        // check convergence across all processes
-        int stop = 0;
-        if(fabs(global_log_lik - prev_log_likelihood) < EPSILON) stop = 1;
-        MPI_Bcast(&stop, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        
-        if(stop) break;
         prev_log_likelihood = global_log_lik;
-    }
 
-    // assign final labels (locally)
-    for (int n = 0; n < num_data_points; n++) {
-        int max_k = 0;
-        for (int k = 1; k < num_clusters; k++)
-            if (resp[n][k] > resp[n][max_k])
-                max_k = k;
-        labels[n] = max_k;
+        // M-step: identical update on every process
+        stats_to_gmm(&stats, gmm, total_N);
+        precompute_gaussians(gmm, num_clusters, dim);
+
+        // the model is the same everywhere, the master saves it
+        if(rank == 0) checkpoint_em(options, gmm, iter + 1, prev_log_likelihood, iter + 1 == MAX_ITER);
+    }
+    ALLOC_CHECK_PRINT()
+    if(rank == 0) printf("[DEBUG] Final log-likelihood: %.6f\n", prev_log_likelihood);
+
+    // assign final labels (locally): argmax of the last E-step's responsibilities
+    if (options->streaming) {
+        predict_labels(data_points, dim, num_data_points, gmm, num_clusters, labels);
+    } else {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for (int n = 0; n < num_data_points; n++) {
+            int max_k = 0;
+            for (int k = 1; k < num_clusters; k++)
+                if (resp[n * num_clusters + k] > resp[n * num_clusters + max_k])
+                    max_k = k;
+            labels[n] = max_k;
+        }
     }
 
-    free_matrix(resp, num_data_points);
+    free_matrix(resp);
+    scratch_teardown();
+    return prev_log_likelihood;
 }
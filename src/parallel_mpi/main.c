@@ -1,16 +1,54 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <mpi.h> // MPI Include
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "../include/commons.h"
 #include "../include/matrix_utils.h"
 #include "../include/utils.h"
+#include "../include/dataset.h"
+#include "../include/init.h"
+#include "../include/restarts.h"
+#include "../include/model_selection.h"
+#include "../include/mpi_utils.h"
+#include "../include/online_em.h"
+#include "../include/model.h"
+#include "../include/predict.h"
+#include "../include/results.h"
 
-#ifdef TOTAL_TIMING
 #include "../include/timing/timing.h"
-#endif
+
+// "w0,w1,..." with exactly 'size' positive integers, NULL otherwise
+static int* parse_weights(const char *list, int size) {
+    int *weights = (int*)malloc(size * sizeof(int));
+    const char *p = list;
+    for (int r = 0; r < size; r++) {
+        char *next;
+        long w = strtol(p, &next, 10);
+        if (next == p || w <= 0 || w > 1000000 || (*next != (r < size - 1 ? ',' : '\0'))) {
+            free(weights);
+            return NULL;
+        }
+        weights[r] = (int)w;
+        p = next + 1;
+    }
+    return weights;
+}
 
 int main(int argc, char *argv[]) {
+#ifdef _OPENMP
+    // hybrid build: OpenMP threads inside every process, only the master thread calls MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED) {
+        fprintf(stderr, "The MPI library does not support MPI_THREAD_FUNNELED\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+#else
     MPI_Init(&argc, &argv); 
+#endif
 
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -18,132 +56,165 @@ int main(int argc, char *argv[]) {
 
     int N, dim, K;
     char dataset_path[256], output_path[256];
-    T** dataset = NULL;
-    T* flat_dataset = NULL; // contiguous buffer for sending data
+    EMOptions options;
 
-    // master process reads the dataset
+    // master process parses the command line
     if (rank == 0) {
-        parsing(argc, argv, &K, dataset_path, output_path);
-        dataset = load_csv(dataset_path, &N, &dim);
-        if (!dataset) {
-            MPI_Abort(MPI_COMM_WORLD, 1);
-            return 1;
-        }
-        printf("[MPI Master] Loaded dataset: %d points, %d coordinates\n", N, dim);
-
-        // flatten the dataset for MPI_Scatter
-        flat_dataset = (T*)malloc(N * dim * sizeof(T));
-        for(int i=0; i<N; i++) {
-            for(int j=0; j<dim; j++) {
-                flat_dataset[i*dim + j] = dataset[i][j];
+        parsing(argc, argv, &K, dataset_path, output_path, &options);
+    }
+    MPI_Bcast(&K, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&options, sizeof(EMOptions), MPI_BYTE, 0, MPI_COMM_WORLD);
+    options.comm = MPI_COMM_WORLD; // a handle is only valid in the process that got it
+    MPI_Bcast(dataset_path, sizeof(dataset_path), MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(output_path, sizeof(output_path), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    // converter mode: master loads the whole dataset and writes the binary file
+    if (options.convert_path[0]) {
+        int exit_code = 0;
+        if (rank == 0) {
+            Dataset ds;
+            exit_code = load_dataset(dataset_path, &ds) == 0 ? 0 : 1;
+            if (exit_code == 0) {
+                exit_code = write_dataset_bin(options.convert_path, ds.data, ds.labels, ds.num_points, ds.dim) == 0 ? 0 : 1;
+                if (exit_code == 0) printf("Wrote %d points, %d dimensions to %s\n", ds.num_points, ds.dim, options.convert_path);
+                free_dataset(&ds);
             }
         }
+        MPI_Finalize();
+        return exit_code;
     }
 
-    // broadcast problem dimensions to all processes
-    MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&dim, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&K, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // predict-only mode: a saved model scores the dataset chunk by chunk, no training
+    if (options.predict_model[0]) {
+        TOTAL_TIMER_START(Predict)
+        int ret = predict(options.predict_model, dataset_path, output_path, &options);
+        TOTAL_TIMER_STOP(Predict)
+        if (ret != 0) MPI_Abort(MPI_COMM_WORLD, 1);
+        MPI_Finalize();
+        return 0;
+    }
 
-    // calculate local data size, assuming N is divisible by size for simplicity.
-    int local_N = N / size; 
-    T* local_flat_data = (T*)malloc(local_N * dim * sizeof(T));
+    // online EM: every process reads one chunk of the dataset per step, never its whole share
+    if (options.online) {
+        long long num_points;
+        TOTAL_TIMER_START(Online_EM)
+        GMM *gmm = online_em(dataset_path, output_path, K, &options, &num_points);
+        TOTAL_TIMER_STOP(Online_EM)
+        if (!gmm) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+            return 1;
+        }
+        if (rank == 0) {
+            printf("[MPI Master] Online EM on %lld points, %d coordinates\n", num_points, gmm->dim);
+            print_cluster_params(gmm);
+            if (options.save_model[0]) export_model(options.save_model, gmm);
+        }
+        free_gmm(gmm);
+        MPI_Finalize();
+        return 0;
+    }
 
-    // distribute data chunks to all processes
-    MPI_Scatter(flat_dataset, local_N * dim, MPI_DOUBLE, 
-                local_flat_data, local_N * dim, MPI_DOUBLE, 
-                0, MPI_COMM_WORLD);
+    // optional weighted partitioning, e.g. for nodes of different speed
+    int *weights = NULL;
+    if (options.weights[0]) {
+        weights = parse_weights(options.weights, size);
+        if (!weights) {
+            if (rank == 0) fprintf(stderr, "--weights needs %d positive integers, one per process\n", size);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+            return 1;
+        }
+    }
 
-    // reconstruct local 2D array structure (array of pointers)
-    T** local_dataset = (T**)malloc(local_N * sizeof(T*));
-    for(int i=0; i<local_N; i++) {
-        local_dataset[i] = &local_flat_data[i * dim];
+    // every process reads its own share of the input (a block of points of a
+    // binary file, a byte range of a CSV): no process holds the whole dataset
+    Dataset local_ds;
+    int loaded = load_dataset_part(dataset_path, weights, rank, size, &local_ds) == 0, all_loaded;
+    MPI_Allreduce(&loaded, &all_loaded, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_loaded) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    T* local_flat_data = local_ds.data;
+    int local_N = local_ds.num_points;
+    dim = local_ds.dim;
+    MPI_Allreduce(&local_N, &N, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (N == 0) {
+        // empty shares are fine (more processes than rows), an empty dataset is not
+        if (rank == 0) fprintf(stderr, "%s: no data rows\n", dataset_path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    if (rank == 0) {
+        printf("[MPI Master] Loaded dataset: %d points, %d coordinates\n", N, dim);
+#ifdef _OPENMP
+        printf("[MPI Master] %d processes x %d OpenMP threads\n", size, omp_get_max_threads());
+#endif
+    }
+    if (weights) {
+        int *counts = (rank == 0) ? (int*)malloc(size * sizeof(int)) : NULL;
+        MPI_Gather(&local_N, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("[MPI Master] Points per process:");
+            for (int r = 0; r < size; r++) printf(" %d", counts[r]);
+            printf("\n");
+        }
+        free(counts);
+        free(weights);
     }
 
     // setup GMM structures
-    Gaussian *gmm = (Gaussian*)malloc(K * sizeof(Gaussian));
+    GMM *gmm = alloc_gmm(K, dim, options.cov_type);
     int *local_labels = (int*)malloc(local_N * sizeof(int));
     
-    // master initializes GMM parameters, others allocate memory
-    if (rank == 0) {
-        init_gmm(gmm, K, dim, dataset, N);
-    } else {
-        for(int k=0; k<K; k++) {
-            gmm[k].mean = (double*)malloc(dim * sizeof(double));
-            gmm[k].cov = alloc_matrix(dim, dim);
-        }
+    // checkpoint (--resume) or saved model (--init-model) read by the master,
+    // otherwise GMM parameters initialized over the points of all processes
+    int model_loaded = 0;
+    if (rank == 0) model_loaded = load_start_model(gmm, &options);
+    MPI_Bcast(&model_loaded, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (model_loaded < 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
     }
+    MPI_Bcast(&options, sizeof(EMOptions), MPI_BYTE, 0, MPI_COMM_WORLD); // iteration to resume from
+    options.comm = MPI_COMM_WORLD;
+    if (!model_loaded && options.n_init == 1 && !options.k_max) init_gmm(gmm, K, dim, local_flat_data, local_N, &options);
 
-    // broadcast initial GMM parameters to all processes
-    for(int k=0; k<K; k++) {
-        MPI_Bcast(gmm[k].mean, dim, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-        MPI_Bcast(&gmm[k].weight, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-        
-        // serialize covariance matrix for broadcasting
-        T* flat_cov = (T*)malloc(dim*dim*sizeof(T));
-        if(rank == 0) {
-            for(int i=0; i<dim; i++)
-                for(int j=0; j<dim; j++)
-                    flat_cov[i*dim+j] = gmm[k].cov[i][j];
-        }
-        MPI_Bcast(flat_cov, dim*dim, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-        if(rank != 0) {
-            for(int i=0; i<dim; i++)
-                for(int j=0; j<dim; j++)
-                    gmm[k].cov[i][j] = flat_cov[i*dim+j];
-        }
-        free(flat_cov);
-    }
+    // make the initial GMM parameters bitwise identical on all processes (one contiguous block)
+    MPI_Bcast(gmm->block, (int)gmm->block_size, MPI_BYTE, 0, MPI_COMM_WORLD);
 
 
     // EM Algorithm Execution 
     TOTAL_TIMER_START(EM_Algorithm)
 
-    // run EM algorithm on local data chunk
-    em_algorithm(local_dataset, dim, local_N, gmm, K, local_labels);
+    // run EM algorithm on local data chunk; -k <min>:<max> fits every K and keeps the
+    // model of the best --criterion, --n-init fits from several initializations
+    if (options.k_max) {
+        free_gmm(gmm);
+        gmm = select_num_clusters(local_flat_data, dim, local_N, K, local_labels, &options);
+        K = gmm->num_clusters;
+    } else if (options.n_init > 1)
+        fit_restarts(local_flat_data, dim, local_N, gmm, K, local_labels, &options);
+    else
+        em_algorithm(local_flat_data, dim, local_N, gmm, K, local_labels, &options);
 
     TOTAL_TIMER_STOP(EM_Algorithm)
-    
-    // collect results (labels) from all processes to master
-    int *all_labels = NULL;
-    if (rank == 0) {
-        all_labels = (int*)malloc(N * sizeof(int));
-    }
-    MPI_Gather(local_labels, local_N, MPI_INT, 
-               all_labels, local_N, MPI_INT, 
-               0, MPI_COMM_WORLD);
 
-    // master prints and saves results
+    // master prints the results
     if (rank == 0) {
-        printf("\nCluster Parameters:\n");
-        printf("%-7s | %-8s | %s\n", "Cluster", "Weight", "Mean");
-        printf("%s\n", "--------+----------+-----------------------------");
-        for (int k = 0; k < K; k++) {
-            printf("%-7d | %-8.3f | [", k, gmm[k].weight);
-            for (int d = 0; d < dim; d++) {
-                printf("%.3f%s", gmm[k].mean[d], d < dim-1 ? ", " : "");
-            }
-            printf("]\n");
-        }
-        write_results_csv(output_path, dataset, all_labels, N, dim);
-        
-        free(all_labels);
-        free(flat_dataset);
-        free_matrix(dataset, N);
+        print_cluster_params(gmm);
+        if (options.save_model[0]) export_model(options.save_model, gmm);
     }
 
+    // every process writes its own points and labels
+    write_results(output_path, &options, local_flat_data, local_labels, gmm, local_N);
+
     // cleanup local memory
-    free(local_flat_data);
-    free(local_dataset); // frees the array of pointers, data is in local_flat_data
+    free_dataset(&local_ds);
     free(local_labels);
     
     // free GMM memory
-    for (int k = 0; k < K; k++) {
-        free(gmm[k].mean);
-        free_matrix(gmm[k].cov, dim);
-    }
-    free(gmm);
+    free_gmm(gmm);
 
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <mpi.h>
+
+#include "../include/commons.h"
+#include "../include/mpi_utils.h"
+#include "../include/utils.h"
+
+// Opens (and truncates, when it is a regular file) the results file on all ranks
+int open_results_mpi(const char *filename, MPI_File *fh) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // an existing regular file is truncated, devices (/dev/null) cannot be
+    int regular = 1;
+    if (rank == 0) {
+        struct stat st;
+        regular = stat(filename, &st) != 0 || S_ISREG(st.st_mode);
+    }
+    MPI_Bcast(&regular, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    int ret = MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, fh);
+    if (ret != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot open for writing\n", filename);
+        return -1;
+    }
+    if (regular) MPI_File_set_size(*fh, 0);
+    return 0;
+}
+
+// Every rank's blocks of text, one after the other and after those of the
+// lower ranks, 'offset' bytes into the file. Collective, returns the bytes
+// written by all ranks or -1 on failure.
+long long write_blocks_mpi(MPI_File fh, long long offset, const TextBuffer *blocks, int num_blocks) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    long long local_len = 0, before = 0, total;
+    for (int j = 0; j < num_blocks; j++)
+        local_len += (long long)blocks[j].len;
+    MPI_Exscan(&local_len, &before, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) before = 0;
+    MPI_Allreduce(&local_len, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    offset += before;
+
+    // writes of at most 1 GiB, counts are ints
+    const size_t max_write = (size_t)1 << 30;
+    int ret = MPI_SUCCESS;
+    for (int j = 0; j < num_blocks && ret == MPI_SUCCESS; j++) {
+        const TextBuffer *b = &blocks[j];
+        for (size_t done = 0; done < b->len && ret == MPI_SUCCESS; done += max_write) {
+            int count = (int)(b->len - done < max_write ? b->len - done : max_write);
+            ret = MPI_File_write_at(fh, (MPI_Offset)(offset + done), b->data + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+        }
+        offset += (long long)b->len;
+    }
+
+    int ok = (ret == MPI_SUCCESS), all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return all_ok ? total : -1;
+}
+
+// One Alltoallv: every rank sends each other rank the part of its rows
+// that falls in the other's wanted range
+void redistribute_rows(const void *src, long long src_first, int src_rows, void *dst, long long dst_first,
+                       int dst_rows, MPI_Datatype row, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    long long mine[4] = {src_first, src_rows, dst_first, dst_rows};
+    long long *ranges = (long long*)malloc(4 * (size_t)size * sizeof(long long));
+    MPI_Allgather(mine, 4, MPI_LONG_LONG, ranges, 4, MPI_LONG_LONG, comm);
+
+    int *send_counts = (int*)malloc(4 * (size_t)size * sizeof(int));
+    int *send_displs = send_counts + size, *recv_counts = send_counts + 2 * size, *recv_displs = send_counts + 3 * size;
+    for (int p = 0; p < size; p++) {
+        const long long *theirs = &ranges[4 * p];
+        // own rows wanted by p
+        long long lo = src_first > theirs[2] ? src_first : theirs[2];
+        long long hi = src_first + src_rows < theirs[2] + theirs[3] ? src_first + src_rows : theirs[2] + theirs[3];
+        send_counts[p] = hi > lo ? (int)(hi - lo) : 0;
+        send_displs[p] = hi > lo ? (int)(lo - src_first) : 0;
+        // rows of p wanted here
+        lo = theirs[0] > dst_first ? theirs[0] : dst_first;
+        hi = theirs[0] + theirs[1] < dst_first + dst_rows ? theirs[0] + theirs[1] : dst_first + dst_rows;
+        recv_counts[p] = hi > lo ? (int)(hi - lo) : 0;
+        recv_displs[p] = hi > lo ? (int)(lo - dst_first) : 0;
+    }
+    MPI_Alltoallv(src, send_counts, send_displs, row, dst, recv_counts, recv_displs, row, comm);
+
+    free(send_counts);
+    free(ranges);
+}
@@ -5,116 +5,154 @@
 
 #include "../include/matrix_utils.h"
 #include "../include/commons.h"
+#include "../include/scratch.h"
+#include "../include/suff_stats.h"
+#include "../include/model.h"
+#include "../include/omp_utils.h"
 
-// E-step
-void e_step(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T* resp) {
-    T* temp_class_resp = (T*)calloc(num_clusters, sizeof(T));
-
-    #pragma omp parallel for reduction(+:temp_class_resp[:num_clusters])
-    for(int i = 0; i < num_data_points; i++) { 
-        T norm = 0.0;
-        int row_offset = i * num_clusters;
-        int data_offset = i * dim;
-
-        for(int k = 0; k < num_clusters; k++) {
-            // Pass pointer to the start of the i-th vector
-            T pdf = multiv_gaussian_pdf(&data_points[data_offset], dim, gmm[k].mean, gmm[k].cov); 
-            resp[row_offset + k] = gmm[k].weight * pdf;
-            norm += resp[row_offset + k];
-        }
+// E-step: log-space responsibilities, returns the log-likelihood of the current parameters
+double e_step(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, T* resp) {
+    double log_lik = 0.0;
 
-        for(int k = 0; k < num_clusters; k++) { 
-            resp[row_offset + k] /= (norm + 1e-18);
-            temp_class_resp[k] += resp[row_offset + k];
-        } 
-    }
+    #pragma omp parallel for schedule(static) reduction(+:log_lik)
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) { 
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+
+        // log(weight * pdf) for a block of points, SIMD across the block
+        log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, &resp[b * num_clusters]);
 
-    for(int k = 0; k < num_clusters; k++) {
-        gmm[k].class_resp = temp_class_resp[k];
+        for(int i = b; i < b + count; i++) {
+            log_lik += log_sum_exp_normalize(&resp[i * num_clusters], num_clusters);
+        }
     }
-    free(temp_class_resp);
+    return log_lik;
 }
 
 
-// M-step
-void m_step(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, T* resp) {
-    for(int k = 0; k < num_clusters; k++) {
-        gmm[k].weight = gmm[k].class_resp / num_data_points;
-        T inv_class_resp = 1.0 / (gmm[k].class_resp + 1e-18);
-        T* current_mean = gmm[k].mean;
-        
-        for(int d = 0; d < dim; d++) current_mean[d] = 0.0;
-
-        #pragma omp parallel for reduction(+:current_mean[:dim])
-        for (int i = 0; i < num_data_points; i++) {
-            T weight = resp[i * num_clusters + k];
-            int data_offset = i * dim;
-            for (int d = 0; d < dim; d++) {
-                current_mean[d] += weight * data_points[data_offset + d];
-            }
+// M-step: one pass over the data accumulates the sufficient statistics of
+// all clusters in per-thread buffers, merged once per thread at the end
+void m_step(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, T* resp) {
+    Scratch* master_scratch = thread_scratch();
+    size_t master_mark = scratch_mark(master_scratch);
+    SuffStats stats;
+    stats_init_scratch(&stats, num_clusters, dim, master_scratch);
+    stats_zero(&stats);
+
+    #pragma omp parallel
+    {
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        SuffStats local_stats;
+        stats_init_scratch(&local_stats, num_clusters, dim, scratch);
+        stats_zero(&local_stats);
+
+        // same partition as the E-step (and the first touch of 'resp')
+        #pragma omp for schedule(static)
+        for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+            int end = (b + POINT_BLOCK < num_data_points) ? b + POINT_BLOCK : num_data_points;
+            for(int n = b; n < end; n++)
+                stats_accumulate(&local_stats, &data_points[n * dim], &resp[n * num_clusters], gmm);
         }
 
-        // Final normalization
-        for (int d = 0; d < dim; d++) current_mean[d] *= inv_class_resp;
-
-        // Update covariance matrix
-        T* temp_cov = (T*)calloc(dim * dim, sizeof(T));
-
-        #pragma omp parallel for reduction(+:temp_cov[:dim*dim])
-        for(int n = 0; n < num_data_points; n++) {
-            T r = resp[n * num_clusters + k];
-            int n_offset = n * dim;
-            for(int i = 0; i < dim; i++) {
-                T diff_i = data_points[n_offset + i] - current_mean[i];
-                for(int j = i; j < dim; j++) {
-                    // Compute only the upper triangular part
-                    temp_cov[i * dim + j] += r * diff_i * (data_points[n_offset + j] - current_mean[j]);
-                }
-            }
-        }
+        #pragma omp critical
+        stats_add(&stats, &local_stats);
 
-        // Final copy to GMM matrix and regularization
-        for(int i = 0; i < dim; i++) {
-            for(int j = i; j < dim; j++) {
-                T val = temp_cov[i * dim + j] * inv_class_resp;
-                gmm[k].cov[i][j] = val;
-                gmm[k].cov[j][i] = val; // Symmetry
-            }
-            gmm[k].cov[i][i] += 1e-6;
-        }
-        free(temp_cov);
+        scratch_release(scratch, mark);
     }
+
+    // Weights, means and covariances (centered form) with regularization
+    stats_to_gmm(&stats, gmm, num_data_points);
+    scratch_release(master_scratch, master_mark);
 }
-void em_algorithm(T* data_points, int dim, int num_data_points, Gaussian* gmm, int num_clusters, int* labels) {
-    T* resp = (T*)malloc(num_data_points * num_clusters * sizeof(T));
-    T prev_log_likelihood = -INFINITY;
 
-    for(int iter = 0; iter < MAX_ITER; iter++){
-        // E-step
-        e_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+// Streaming E-step: every thread folds the responsibilities of its blocks
+// straight into private M-step statistics, merged into 'stats' at the end.
+// Returns the log-likelihood of the current parameters.
+double e_step_streaming(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, SuffStats* stats) {
+    stats_zero(stats);
+
+    #pragma omp parallel
+    {
+        Scratch* scratch = thread_scratch();
+        size_t mark = scratch_mark(scratch);
+        SuffStats local_stats;
+        stats_init_scratch(&local_stats, num_clusters, dim, scratch);
+        stats_zero(&local_stats);
+
+        #pragma omp for schedule(static)
+        for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+            int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+            stats_accumulate_block(&local_stats, &data_points[b * dim], count, gmm);
+        }
 
-        // M-step
-        m_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+        #pragma omp critical
+        stats_add(stats, &local_stats);
 
-        double log_lik = log_likelihood(data_points, dim, num_data_points, gmm, num_clusters);
+        scratch_release(scratch, mark);
+    }
+    return *stats->log_lik;
+}
 
-        if(fabs(log_lik - prev_log_likelihood) < EPSILON){
+double em_algorithm(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels, EMOptions* options) {
+    // The streaming mode never materializes the N x K responsibilities
+    T* resp = options->streaming ? NULL : (T*)first_touch_alloc(num_data_points, num_clusters * sizeof(T));
+    double prev_log_likelihood = options->start_log_lik; // -INFINITY unless resuming
+
+    // E-step kernel buffers and M-step statistics per thread, plus the merged
+    // statistics on the master (thread 0 also owns the master's arena)
+    scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(dim, num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS)
+                  + SCRATCH_BYTES(2 * STATS_ELEMS(num_clusters, dim), sizeof(double), 2));
+    precompute_gaussians(gmm, num_clusters, dim);
+
+    SuffStats stats;
+    if (options->streaming)
+        stats_init_scratch(&stats, num_clusters, dim, thread_scratch());
+
+    ALLOC_CHECK_DEF()
+    for(int iter = options->start_iter; iter < options->max_iter; iter++){
+        ALLOC_CHECK_START(iter)
+        // E-step (also yields the log-likelihood of the current parameters)
+        double log_lik = options->streaming
+            ? e_step_streaming(data_points, dim, num_data_points, gmm, num_clusters, &stats)
+            : e_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+
+        if(LOG_LIK_CONVERGED(log_lik, prev_log_likelihood, num_data_points)){
             printf("[DEBUG] Convergence reached at iteration %d.\n", iter + 1);
+            checkpoint_em(options, gmm, iter, prev_log_likelihood, 1);
             break;
         }
         prev_log_likelihood = log_lik;
-    }
 
-    #pragma omp parallel for
-    for (int n = 0; n < num_data_points; n++) {
-        int max_k = 0;
-        int offset = n * num_clusters;
-        for (int k = 1; k < num_clusters; k++) {
-            if (resp[offset + k] > resp[offset + max_k])
-                max_k = k;
+        // M-step
+        if (options->streaming)
+            stats_to_gmm(&stats, gmm, num_data_points);
+        else
+            m_step(data_points, dim, num_data_points, gmm, num_clusters, resp);
+        precompute_gaussians(gmm, num_clusters, dim);
+        checkpoint_em(options, gmm, iter + 1, prev_log_likelihood, iter + 1 == MAX_ITER);
+    }
+    ALLOC_CHECK_PRINT()
+    printf("[DEBUG] Final log-likelihood: %.6f\n", prev_log_likelihood);
+
+    if (options->streaming) {
+        predict_labels(data_points, dim, num_data_points, gmm, num_clusters, labels);
+    } else {
+        #pragma omp parallel for schedule(static)
+        for (int b = 0; b < num_data_points; b += POINT_BLOCK) {
+            int end = (b + POINT_BLOCK < num_data_points) ? b + POINT_BLOCK : num_data_points;
+            for (int n = b; n < end; n++) {
+                int max_k = 0;
+                int offset = n * num_clusters;
+                for (int k = 1; k < num_clusters; k++) {
+                    if (resp[offset + k] > resp[offset + max_k])
+                        max_k = k;
+                }
+                labels[n] = max_k;
+            }
         }
-        labels[n] = max_k;
     }
 
     free(resp);
-}
\ No newline at end of file
+    scratch_teardown();
+    return prev_log_likelihood;
+}
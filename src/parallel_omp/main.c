@@ -7,33 +7,98 @@
 #include "../include/commons.h"
 #include "../include/matrix_utils.h"
 #include "../include/utils.h"
+#include "../include/dataset.h"
+#include "../include/init.h"
+#include "../include/restarts.h"
+#include "../include/model_selection.h"
+#include "../include/omp_utils.h"
+#include "../include/online_em.h"
+#include "../include/model.h"
+#include "../include/predict.h"
+#include "../include/results.h"
 
-#ifdef TOTAL_TIMING
 #include "../include/timing/timing.h"
-#endif
 
 
 int main(int argc, char *argv[]) {
     int N, dim, K;
     char dataset_path[256], output_path[256];
+    EMOptions options;
 
-    parsing(argc, argv, &K, dataset_path, output_path);
+    parsing(argc, argv, &K, dataset_path, output_path, &options);
 
-    T* dataset = load_csv(dataset_path, &N, &dim);
-    if (!dataset) {
+    // pin before anything is first touched, so the pages follow the threads
+    if (options.affinity == AFFINITY_PIN) pin_threads();
+    if (options.affinity) report_affinity();
+
+    // predict-only mode: a saved model scores the dataset, no training
+    if (options.predict_model[0]) {
+        TOTAL_TIMER_START(Predict)
+        int ret = predict(options.predict_model, dataset_path, output_path, &options);
+        TOTAL_TIMER_STOP(Predict)
+        return ret == 0 ? 0 : 1;
+    }
+
+    // online EM: the dataset is read one mini-batch at a time, never whole
+    if (options.online) {
+        long long num_points;
+        TOTAL_TIMER_START(Online_EM)
+        GMM *gmm = online_em(dataset_path, output_path, K, &options, &num_points);
+        TOTAL_TIMER_STOP(Online_EM)
+        if (!gmm) {
+            printf("Failed to load dataset\n");
+            return 1;
+        }
+        printf("%lld, %d, %d, %d, ", num_points, K, gmm->dim, omp_get_max_threads());
+        GET_DURATION(Online_EM)
+        printf("\n");
+        if (options.save_model[0]) export_model(options.save_model, gmm);
+        free_gmm(gmm);
+        return 0;
+    }
+
+    // CSV or binary (memory-mapped, used in place)
+    Dataset ds;
+    if (load_dataset(dataset_path, &ds) != 0) {
         printf("Failed to load dataset\n");
         return 1;
     }
+    T* dataset = ds.data;
+    N = ds.num_points;
+    dim = ds.dim;
 
+    if (options.convert_path[0]) {
+        int ret = write_dataset_bin(options.convert_path, dataset, ds.labels, N, dim);
+        if (ret == 0) printf("Wrote %d points, %d dimensions to %s\n", N, dim, options.convert_path);
+        free_dataset(&ds);
+        return ret == 0 ? 0 : 1;
+    }
+
+
+    // spread the points over the NUMA nodes of the threads that process them
+    place_dataset(&ds);
+    dataset = ds.data;
 
-    Gaussian *gmm = (Gaussian*)malloc(K * sizeof(Gaussian));
-    int *labels = (int*)malloc(N * sizeof(int));
-    init_gmm(gmm, K, dim, dataset, N);
+    GMM *gmm = alloc_gmm(K, dim, options.cov_type);
+    int *labels = (int*)first_touch_alloc(N, sizeof(int));
+    // checkpoint (--resume) or saved model (--init-model), random initialization otherwise
+    int loaded = load_start_model(gmm, &options);
+    if (loaded < 0) return 1;
+    if (!loaded && options.n_init == 1 && !options.k_max) init_gmm(gmm, K, dim, dataset, N, &options);
 
     // ********** EM Algorithm Execution ************
     TOTAL_TIMER_START(EM_Algorithm)
 
-    em_algorithm(dataset, dim, N, gmm, K, labels);
+    // -k <min>:<max> fits every K and keeps the model of the best --criterion,
+    // --n-init fits from several initializations and keeps the best one
+    if (options.k_max) {
+        free_gmm(gmm);
+        gmm = select_num_clusters(dataset, dim, N, K, labels, &options);
+        K = gmm->num_clusters;
+    } else if (options.n_init > 1)
+        fit_restarts(dataset, dim, N, gmm, K, labels, &options);
+    else
+        em_algorithm(dataset, dim, N, gmm, K, labels, &options);
 
     TOTAL_TIMER_STOP(EM_Algorithm)
     // **********************************************
@@ -48,15 +113,13 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    write_results(output_path, &options, dataset, labels, gmm, N);
+    if (options.save_model[0]) export_model(options.save_model, gmm);
+
     // Cleanup
-    #pragma omp parallel for
-    for (int k = 0; k < K; k++) {
-        free(gmm[k].mean);
-        free_matrix(gmm[k].cov, dim);
-    }
-    free(gmm);
+    free_gmm(gmm);
     free(labels);
-    free(dataset);
+    free_dataset(&ds);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "../include/omp_utils.h"
+
+// NUMA nodes online, from sysfs ("0", "0-1", "0,2-3", ...); 1 if unknown
+int numa_num_nodes(void) {
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");
+    if (!fp) return 1;
+    char list[256];
+    int nodes = 0;
+    if (fgets(list, sizeof(list), fp)) {
+        for (char *p = list; *p && *p != '\n';) {
+            char *next;
+            long first = strtol(p, &next, 10), last = first;
+            if (next == p) break;
+            if (*next == '-') last = strtol(next + 1, &next, 10);
+            nodes += (int)(last - first + 1);
+            p = (*next == ',') ? next + 1 : next;
+        }
+    }
+    fclose(fp);
+    return nodes > 0 ? nodes : 1;
+}
+
+// Zeroed buffer of 'num_points' rows whose pages are first touched by the
+// thread that processes the rows in the E- and M-steps
+void* first_touch_alloc(int num_points, size_t bytes_per_point) {
+    char *buf = (char*)malloc((size_t)num_points * bytes_per_point);
+    if (!buf) return NULL;
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < num_points; b += POINT_BLOCK) {
+        int count = (num_points - b < POINT_BLOCK) ? num_points - b : POINT_BLOCK;
+        memset(buf + (size_t)b * bytes_per_point, 0, (size_t)count * bytes_per_point);
+    }
+    return buf;
+}
+
+// Moves the points of a loaded dataset into a first-touched copy. The CSV
+// loader's chunks and the page cache behind a mapped binary file do not
+// follow the compute partition; on a single node there is nothing to gain.
+void place_dataset(Dataset *ds) {
+    if (numa_num_nodes() < 2) return;
+
+    size_t row_bytes = (size_t)ds->dim * sizeof(T);
+    T *data = (T*)malloc((size_t)ds->num_points * row_bytes);
+    if (!data) return; // keep the original placement
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < ds->num_points; b += POINT_BLOCK) {
+        int count = (ds->num_points - b < POINT_BLOCK) ? ds->num_points - b : POINT_BLOCK;
+        memcpy(&data[(size_t)b * ds->dim], &ds->data[(size_t)b * ds->dim], (size_t)count * row_bytes);
+    }
+
+    int *labels = ds->labels;
+    ds->labels = NULL;
+    free_dataset(ds);
+    ds->data = data;
+    ds->labels = labels;
+}
+
+void pin_threads(void) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity");
+        return;
+    }
+    int num_cpus = CPU_COUNT(&allowed);
+
+    #pragma omp parallel
+    {
+        // t-th allowed CPU, wrapping around when oversubscribed
+        int target = omp_get_thread_num() % num_cpus, cpu = -1;
+        for (int c = 0; c < CPU_SETSIZE && target >= 0; c++)
+            if (CPU_ISSET(c, &allowed) && target-- == 0) cpu = c;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+            fprintf(stderr, "Thread %d: cannot pin to CPU %d: %s\n", omp_get_thread_num(), cpu, strerror(err));
+    }
+}
+
+static int cpu_node(int cpu) {
+    char path[64];
+    for (int node = 0; node < 1024; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) return node;
+    }
+    return 0;
+}
+
+void report_affinity(void) {
+    int num_threads = omp_get_max_threads();
+    int *cpus = (int*)malloc(num_threads * sizeof(int));
+    for (int t = 0; t < num_threads; t++) cpus[t] = -1;
+
+    #pragma omp parallel
+    cpus[omp_get_thread_num()] = sched_getcpu();
+
+    printf("[OMP] %d threads, %d NUMA node(s)\n", num_threads, numa_num_nodes());
+    for (int t = 0; t < num_threads; t++)
+        if (cpus[t] >= 0) printf("[OMP] thread %d: CPU %d, node %d\n", t, cpus[t], cpu_node(cpus[t]));
+    free(cpus);
+}
@@ -0,0 +1,124 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_MPI
+#include <mpi.h>
+#include "include/mpi_utils.h"
+#endif
+
+#include "include/commons.h"
+#include "include/dataset.h"
+#include "include/model.h"
+#include "include/scratch.h"
+#include "include/utils.h"
+#include "include/predict.h"
+#include "include/results.h"
+
+// Chunk 'chunk' of the dataset, left empty past the last one
+static void load_chunk(const DatasetChunks *chunks, int chunk, int dim, Dataset *ds) {
+    memset(ds, 0, sizeof(*ds));
+    if (chunk >= chunks->num_chunks) return;
+    if (dataset_chunk_load(chunks, chunk, ds) != 0 || ds->dim != dim) {
+        if (ds->data) fprintf(stderr, "%s: %d coordinates, the model has %d\n", chunks->path, ds->dim, dim);
+#ifdef USE_MPI
+        MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+        exit(1);
+    }
+}
+
+// Responsibilities, log-density and label of every point, blocks of
+// points in parallel. Scratch set up and 'gmm' precomputed.
+void score_points(T* data_points, int num_data_points, GMM* gmm, T* resp, T* log_density, int* labels) {
+    int dim = gmm->dim, num_clusters = gmm->num_clusters;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for(int b = 0; b < num_data_points; b += POINT_BLOCK) {
+        int count = (num_data_points - b < POINT_BLOCK) ? num_data_points - b : POINT_BLOCK;
+        log_joint_block(&data_points[b * dim], count, dim, gmm, num_clusters, &resp[b * num_clusters]);
+
+        for(int i = b; i < b + count; i++) {
+            T* row = &resp[i * num_clusters];
+            log_density[i] = log_sum_exp_normalize(row, num_clusters);
+            int max_k = 0;
+            for(int k = 1; k < num_clusters; k++) {
+                if(row[k] > row[max_k]) max_k = k;
+            }
+            labels[i] = max_k;
+        }
+    }
+}
+
+// Chunk by chunk, like the online EM: process p scores chunk r * size + p
+// in round r and the rounds are written in file order
+int predict(const char *model_path, const char *dataset_path, const char *output_path, const EMOptions *options) {
+    int rank = 0, size = 1;
+#ifdef USE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+
+    int num_clusters, dim, cov_type, iteration;
+    double model_log_lik;
+    if (model_info(model_path, &num_clusters, &dim, &cov_type) != 0) return -1;
+    GMM *gmm = alloc_gmm(num_clusters, dim, cov_type);
+    DatasetChunks chunks;
+    if (load_model(model_path, gmm, &iteration, &model_log_lik) != 0
+        || dataset_chunks_open(dataset_path, PREDICT_CHUNK_POINTS, &chunks) != 0) {
+        free_gmm(gmm);
+        return -1;
+    }
+    int num_rounds = (chunks.num_chunks + size - 1) / size;
+
+    int columns = options->output_columns == RESULTS_DEFAULT ? RESULTS_RESP : options->output_columns;
+    ResultsWriter w;
+    if (results_open(&w, output_path, columns, options->output_binary, results_num_values(columns, gmm)) != 0) {
+        free_gmm(gmm);
+        return -1;
+    }
+
+    scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(dim, num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS));
+    precompute_gaussians(gmm, num_clusters, dim);
+
+    long long num_points = 0;
+    double sum_log_density = 0.0;
+    int ret = 0;
+    for (int r = 0; r < num_rounds && ret == 0; r++) {
+        Dataset ds;
+        load_chunk(&chunks, r * size + rank, dim, &ds);
+        int n = ds.num_points;
+        T *resp = (T*)malloc(((size_t)n * num_clusters + 1) * sizeof(T));
+        T *log_density = (T*)malloc(((size_t)n + 1) * sizeof(T));
+        int *labels = (int*)malloc(((size_t)n + 1) * sizeof(int));
+
+        score_points(ds.data, n, gmm, resp, log_density, labels);
+        for (int i = 0; i < n; i++)
+            sum_log_density += log_density[i];
+        num_points += n;
+
+        ResultRows rows = { ds.data, resp, log_density, labels };
+        ret = results_write(&w, &rows, n);
+        free(resp);
+        free(log_density);
+        free(labels);
+        free_dataset(&ds);
+    }
+
+    if (results_close(&w) != 0) ret = -1;
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &num_points, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &sum_log_density, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+    if (ret != 0 && rank == 0)
+        fprintf(stderr, "%s: write failed\n", output_path);
+    else if (rank == 0)
+        printf("[DEBUG] Scored %lld points with %d clusters, mean log-density %.6f\n",
+               num_points, num_clusters, sum_log_density / num_points);
+
+    scratch_teardown();
+    free_gmm(gmm);
+    return ret;
+}
@@ -0,0 +1,277 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_MPI
+#include <mpi.h>
+#include "include/dataset.h"
+#include "include/mpi_utils.h"
+#endif
+
+#include "include/commons.h"
+#include "include/init.h"
+#include "include/scratch.h"
+#include "include/restarts.h"
+
+// Teams of threads in the OpenMP build; the hybrid build splits the processes only
+#if defined(_OPENMP) && !defined(USE_MPI)
+#define RESTART_TEAMS
+#endif
+
+// A group of processes (MPI), a team of threads (OpenMP) or the whole
+// program (sequential build) and its restarts first, first + step, ...
+typedef struct {
+    T *data;            // Points it fits, under MPI its own share of all of them
+    int num_points;
+    long long data_first; // Global index of data[0]
+    int dim, num_clusters, n_init;
+    unsigned int seed;  // Restart r starts from seed + r
+    int first, step;
+    EMOptions run;      // Options of its fits, under MPI with the group's communicator
+    int *run_labels;    // Labels of the running fit, and of its best one
+    int *best_labels;
+} RestartGroup;
+
+// Best of the restarts first, first + step, ... < n that ran to the end (-1
+// if none): the highest log-likelihood, ties (the same optimum up to the
+// convergence threshold) going to the lowest seed
+static int best_restart(const double *log_lik, int first, int step, int n) {
+    int best = -1;
+    for (int r = first; r < n; r += step) {
+        if (log_lik[r] == -INFINITY) continue;
+        if (best < 0 || log_lik[r] > log_lik[best] + EPSILON) best = r;
+    }
+    return best;
+}
+
+static void seed_restarts(RestartGroup *g, GMM **models, int cov_type) {
+    for (int r = g->first; r < g->n_init; r += g->step) {
+        g->run.seed = g->seed + r;
+        models[r] = alloc_gmm(g->num_clusters, g->dim, cov_type);
+        init_gmm(models[r], g->num_clusters, g->dim, g->data, g->num_points, &g->run);
+#ifdef USE_MPI
+        MPI_Bcast(models[r]->block, (int)models[r]->block_size, MPI_BYTE, 0, g->run.comm);
+#endif
+    }
+}
+
+// 1. the group's restarts for a few iterations
+static void probe_restarts(RestartGroup *g, GMM **models, double *probe_log_lik) {
+    g->run.start_iter = 0;
+    g->run.start_log_lik = -INFINITY;
+    g->run.max_iter = NINIT_PROBE_ITERS < MAX_ITER ? NINIT_PROBE_ITERS : MAX_ITER;
+    for (int r = g->first; r < g->n_init; r += g->step)
+        probe_log_lik[r] = em_algorithm(g->data, g->dim, g->num_points, models[r], g->num_clusters,
+                                        g->run_labels, &g->run);
+}
+
+// 2. those not far behind the leader run to convergence (from where they
+// stopped, as a resumed run), the others keep -INFINITY; the labels of the
+// group's best fit are kept
+static void finish_restarts(RestartGroup *g, GMM **models, const double *probe_log_lik, int leader,
+                            long long total_points, double *log_lik) {
+    g->run.start_iter = g->run.max_iter;
+    g->run.max_iter = MAX_ITER;
+    for (int r = g->first; r < g->n_init; r += g->step) {
+        if (r != leader && !((probe_log_lik[leader] - probe_log_lik[r]) / total_points <= NINIT_ABANDON_GAP))
+            continue;
+        g->run.start_log_lik = probe_log_lik[r];
+        log_lik[r] = em_algorithm(g->data, g->dim, g->num_points, models[r], g->num_clusters, g->run_labels, &g->run);
+        if (best_restart(log_lik, g->first, g->step, r + 1) == r) {
+            int *swap = g->best_labels;
+            g->best_labels = g->run_labels;
+            g->run_labels = swap;
+        }
+    }
+}
+
+#ifdef USE_MPI
+// Groups of processes: one per restart, at most one per process, fewer if
+// a group's share of the points would overflow the int indexing of the
+// local arrays (N x D points, N x K responsibilities)
+static int process_groups(int n_init, int size, long long total_points, int dim, int num_clusters) {
+    int groups = n_init < size ? n_init : size;
+    int width = dim > num_clusters ? dim : num_clusters;
+    while (groups > 1 && (total_points + size / groups - 1) / (size / groups) > INT_MAX / width)
+        groups--;
+    return groups;
+}
+#endif
+
+#ifdef RESTART_TEAMS
+// Phase 1 or 2 of all the teams at once: one thread per team, the master of
+// a nested team of its share of the threads
+static void run_teams(RestartGroup *groups, int num_groups, int num_threads, int phase, GMM **models,
+                      double *probe_log_lik, int leader, long long total_points, double *log_lik) {
+    #pragma omp parallel num_threads(num_groups)
+    {
+        int g = omp_get_thread_num();
+        omp_set_num_threads(num_threads / num_groups + (g < num_threads % num_groups));
+        if (phase == 1)
+            probe_restarts(&groups[g], models, probe_log_lik);
+        else
+            finish_restarts(&groups[g], models, probe_log_lik, leader, total_points, log_lik);
+    }
+}
+#endif
+
+double fit_restarts(T* data_points, int dim, int num_data_points, GMM* gmm, int num_clusters, int* labels,
+                    EMOptions* options) {
+    int rank = 0, n_init = options->n_init, num_groups = 1, group = 0;
+    long long total_points = num_data_points;
+#ifdef USE_MPI
+    int size;
+    MPI_Comm_rank(options->comm, &rank);
+    MPI_Comm_size(options->comm, &size);
+    MPI_Allreduce(MPI_IN_PLACE, &total_points, 1, MPI_LONG_LONG, MPI_SUM, options->comm);
+    num_groups = process_groups(n_init, size, total_points, dim, num_clusters);
+    group = (int)((long long)rank * num_groups / size); // consecutive ranks
+#elif defined(RESTART_TEAMS)
+    int num_threads = omp_get_max_threads();
+    num_groups = n_init < num_threads ? n_init : num_threads;
+#endif
+    if (rank == 0)
+        printf("[DEBUG] %d restarts, %d at a time\n", n_init, num_groups);
+
+    GMM **models = (GMM**)calloc(n_init, sizeof(GMM*));
+    double *probe_log_lik = (double*)malloc(2 * (size_t)n_init * sizeof(double));
+    double *log_lik = probe_log_lik + n_init;
+    for (int r = 0; r < 2 * n_init; r++) probe_log_lik[r] = -INFINITY;
+
+    // restart r runs on group r % num_groups; the calling process belongs to
+    // one group (MPI), the calling thread opens all the teams (OpenMP)
+    RestartGroup *groups = (RestartGroup*)calloc(num_groups, sizeof(RestartGroup));
+    for (int g = 0; g < num_groups; g++) {
+        groups[g].data = data_points;
+        groups[g].num_points = num_data_points;
+        groups[g].dim = dim;
+        groups[g].num_clusters = num_clusters;
+        groups[g].n_init = n_init;
+        groups[g].seed = options->seed;
+        groups[g].first = g;
+        groups[g].step = num_groups;
+        groups[g].run = *options;
+    }
+    RestartGroup *mine = &groups[group];
+#ifdef USE_MPI
+    // a group fits all the points: its own copy, evenly over its processes
+    long long local_first = 0;
+    if (num_groups > 1) {
+        long long local_points = num_data_points;
+        MPI_Exscan(&local_points, &local_first, 1, MPI_LONG_LONG, MPI_SUM, options->comm);
+        if (rank == 0) local_first = 0; // undefined on rank 0
+
+        int group_rank, group_size;
+        long long begin, end;
+        MPI_Comm_split(options->comm, group, rank, &mine->run.comm);
+        MPI_Comm_rank(mine->run.comm, &group_rank);
+        MPI_Comm_size(mine->run.comm, &group_size);
+        partition_range(total_points, NULL, group_rank, group_size, &begin, &end);
+        mine->data_first = begin;
+        mine->num_points = (int)(end - begin);
+        mine->data = (T*)malloc(((size_t)mine->num_points * dim + 1) * sizeof(T));
+
+        MPI_Datatype point;
+        MPI_Type_contiguous(dim, MPI_T, &point);
+        MPI_Type_commit(&point);
+        redistribute_rows(data_points, local_first, num_data_points, mine->data, begin, mine->num_points,
+                          point, options->comm);
+        MPI_Type_free(&point);
+    }
+#endif
+    for (int g = 0; g < num_groups; g++) {
+#ifdef USE_MPI
+        if (g != group) continue;
+#endif
+        groups[g].run_labels = (int*)malloc(((size_t)groups[g].num_points + 1) * sizeof(int));
+        groups[g].best_labels = (int*)malloc(((size_t)groups[g].num_points + 1) * sizeof(int));
+    }
+
+    // 1. every restart for a few iterations, the groups side by side
+#ifdef RESTART_TEAMS
+    // init_gmm draws from rand(): the teams get their models seeded one after
+    // the other, each on all the threads
+    for (int g = 0; g < num_groups; g++)
+        seed_restarts(&groups[g], models, options->cov_type);
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(omp_get_active_level() + 2);
+    scratch_teams(num_groups);
+    run_teams(groups, num_groups, num_threads, 1, models, probe_log_lik, 0, total_points, log_lik);
+#else
+    seed_restarts(mine, models, options->cov_type);
+    probe_restarts(mine, models, probe_log_lik);
+#endif
+#ifdef USE_MPI
+    // the one exchange between the groups before the end: all the probes' log-likelihoods
+    MPI_Allreduce(MPI_IN_PLACE, probe_log_lik, n_init, MPI_DOUBLE, MPI_MAX, options->comm);
+#endif
+
+    // 2. the ones far behind the leader are dropped, the others run to convergence
+    int leader = 0;
+    for (int r = 1; r < n_init; r++)
+        if (probe_log_lik[r] > probe_log_lik[leader]) leader = r;
+#ifdef RESTART_TEAMS
+    run_teams(groups, num_groups, num_threads, 2, models, probe_log_lik, leader, total_points, log_lik);
+    scratch_teams(0);
+    omp_set_max_active_levels(max_levels);
+#else
+    finish_restarts(mine, models, probe_log_lik, leader, total_points, log_lik);
+#endif
+#ifdef USE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, log_lik, n_init, MPI_DOUBLE, MPI_MAX, options->comm);
+#endif
+
+    // the best of the groups' best fits, whose labels they kept
+    int best = -1;
+    for (int r = 0; r < n_init; r++)
+        if (best_restart(log_lik, r % num_groups, num_groups, n_init) == r
+            && (best < 0 || log_lik[r] > log_lik[best] + EPSILON))
+            best = r;
+    if (rank == 0) {
+        for (int r = 0; r < n_init; r++) {
+            if (log_lik[r] == -INFINITY)
+                printf("[DEBUG] Restart %d (seed %u) abandoned, log-likelihood %.6f after %d iterations\n",
+                       r, options->seed + r, probe_log_lik[r], mine->run.start_iter);
+            else
+                printf("[DEBUG] Restart %d (seed %u): log-likelihood %.6f\n", r, options->seed + r, log_lik[r]);
+        }
+        printf("[DEBUG] Best of %d restarts: %d (seed %u)\n", n_init, best, options->seed + best);
+    }
+
+#ifdef USE_MPI
+    // from the winning group: the model from its first process, the labels
+    // back to the points of every process
+    int winner = best % num_groups;
+    int root = (int)(((long long)winner * size + num_groups - 1) / num_groups);
+    if (rank == root) memcpy(gmm->block, models[best]->block, gmm->block_size);
+    MPI_Bcast(gmm->block, (int)gmm->block_size, MPI_BYTE, root, options->comm);
+    if (num_groups > 1) {
+        int sends = (group == winner);
+        redistribute_rows(sends ? mine->best_labels : NULL, mine->data_first, sends ? mine->num_points : 0,
+                          labels, local_first, num_data_points, MPI_INT, options->comm);
+        MPI_Comm_free(&mine->run.comm);
+        free(mine->data);
+    } else {
+        memcpy(labels, mine->best_labels, (size_t)num_data_points * sizeof(int));
+    }
+#else
+    memcpy(gmm->block, models[best]->block, gmm->block_size);
+    memcpy(labels, groups[best % num_groups].best_labels, (size_t)num_data_points * sizeof(int));
+#endif
+    double best_log_lik = log_lik[best];
+
+    for (int r = 0; r < n_init; r++)
+        free_gmm(models[r]);
+    for (int g = 0; g < num_groups; g++) {
+        free(groups[g].run_labels);
+        free(groups[g].best_labels);
+    }
+    free(groups);
+    free(models);
+    free(probe_log_lik);
+    return best_log_lik;
+}
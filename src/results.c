@@ -0,0 +1,282 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_MPI
+#include <mpi.h>
+#include "include/mpi_utils.h"
+#endif
+
+#include "include/commons.h"
+#include "include/dataset.h"
+#include "include/predict.h"
+#include "include/scratch.h"
+#include "include/results.h"
+
+int parse_output_format(const char *name, int *columns, int *binary) {
+    static const struct { const char *name; int columns, binary; } formats[] = {
+        { "csv", RESULTS_POINTS, 0 }, { "bin", RESULTS_POINTS, 1 },
+        { "labels", RESULTS_LABELS, 0 }, { "labels-bin", RESULTS_LABELS, 1 },
+        { "resp", RESULTS_RESP, 0 }, { "resp-bin", RESULTS_RESP, 1 },
+    };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        if (strcmp(name, formats[f].name) == 0) {
+            *columns = formats[f].columns;
+            *binary = formats[f].binary;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void text_put_uint(TextBuffer *b, unsigned long long v) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) b->data[b->len++] = digits[--n];
+}
+
+// "%.6f" without printf: |v| * 1e6 rounded to an integer. The product is
+// off by at most half an ulp, so the rounding is exact unless it lies that
+// close to a tie; those, and huge or non-finite values, go through printf.
+// Needs 32 bytes of room.
+static void text_put_fixed6(TextBuffer *b, double v) {
+    double scaled = fabs(v) * 1e6;
+    double whole = floor(scaled), frac = scaled - whole;
+    if (!(scaled < 1e15) || fabs(frac - 0.5) <= scaled * 4.5e-16) {
+        text_append(b, "%.6f", v);
+        return;
+    }
+
+    unsigned long long n = (unsigned long long)whole + (frac > 0.5);
+    if (signbit(v)) b->data[b->len++] = '-';
+    text_put_uint(b, n / 1000000);
+    b->data[b->len++] = '.';
+    unsigned long long decimals = n % 1000000;
+    for (int i = 5; i >= 0; i--) {
+        b->data[b->len + i] = (char)('0' + decimals % 10);
+        decimals /= 10;
+    }
+    b->len += 6;
+}
+
+// Text (or binary records) of rows [begin, end) appended to 'b'
+static void format_rows(const ResultsWriter *w, const ResultRows *rows, int begin, int end, TextBuffer *b) {
+    int num_values = w->num_values;
+
+    if (w->binary) {
+        size_t record = sizeof(int32_t) + (size_t)num_values * sizeof(T);
+        text_reserve(b, record * (size_t)(end - begin));
+        for (int i = begin; i < end; i++) {
+            char *p = b->data + b->len;
+            int32_t label = rows->labels[i] + 1;
+            memcpy(p, &label, sizeof(label));
+            p += sizeof(label);
+            if (w->columns == RESULTS_POINTS) {
+                memcpy(p, &rows->points[(size_t)i * num_values], num_values * sizeof(T));
+            } else if (w->columns == RESULTS_RESP) {
+                memcpy(p, &rows->log_density[i], sizeof(T));
+                memcpy(p + sizeof(T), &rows->resp[(size_t)i * (num_values - 1)], (num_values - 1) * sizeof(T));
+            }
+            b->len += record;
+        }
+        return;
+    }
+
+    for (int i = begin; i < end; i++) {
+        if (w->columns == RESULTS_POINTS) {
+            for (int d = 0; d < num_values; d++) {
+                text_reserve(b, 32);
+                text_put_fixed6(b, rows->points[(size_t)i * num_values + d]);
+                b->data[b->len++] = ',';
+            }
+        }
+        text_reserve(b, 32);
+        text_put_uint(b, (unsigned long long)(rows->labels[i] + 1));
+        if (w->columns == RESULTS_RESP) {
+            const T *resp = &rows->resp[(size_t)i * (num_values - 1)];
+            b->data[b->len++] = ',';
+            text_put_fixed6(b, rows->log_density[i]);
+            for (int k = 0; k < num_values - 1; k++) {
+                text_reserve(b, 32);
+                b->data[b->len++] = ',';
+                text_put_fixed6(b, resp[k]);
+            }
+        }
+        b->data[b->len++] = '\n';
+    }
+}
+
+// Blocks [0, num_blocks) of RESULTS_BLOCK_ROWS rows starting at row
+// 'first', formatted in parallel into w->blocks
+static void format_blocks(ResultsWriter *w, const ResultRows *rows, int first, int num_rows, int num_blocks) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1)
+#endif
+    for (int j = 0; j < num_blocks; j++) {
+        int begin = first + j * RESULTS_BLOCK_ROWS;
+        int end = (begin + RESULTS_BLOCK_ROWS < num_rows) ? begin + RESULTS_BLOCK_ROWS : num_rows;
+        w->blocks[j].len = 0;
+        format_rows(w, rows, begin, end, &w->blocks[j]);
+    }
+}
+
+static void ensure_blocks(ResultsWriter *w, int num_blocks) {
+    if (num_blocks <= w->num_blocks) return;
+    w->blocks = (TextBuffer*)realloc(w->blocks, num_blocks * sizeof(TextBuffer));
+    memset(&w->blocks[w->num_blocks], 0, (num_blocks - w->num_blocks) * sizeof(TextBuffer));
+    w->num_blocks = num_blocks;
+}
+
+int results_open(ResultsWriter *w, const char *path, int columns, int binary, int num_values) {
+    memset(w, 0, sizeof(*w));
+    w->columns = columns;
+    w->binary = binary;
+    w->num_values = num_values;
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    ensure_blocks(w, num_threads);
+
+    // header, by the master alone under MPI
+    int rank = 0;
+#ifdef USE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+    TextBuffer *header = &w->blocks[0];
+    if (rank == 0 && binary) {
+        ResultsHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RESULTS_MAGIC, 8);
+        h.endian_tag = DATASET_ENDIAN_TAG;
+        h.dtype = sizeof(T) == sizeof(float) ? DATASET_FLOAT32 : DATASET_FLOAT64;
+        h.columns = (uint32_t)columns;
+        h.num_values = (uint32_t)num_values;
+        text_reserve(header, sizeof(h));
+        memcpy(header->data, &h, sizeof(h));
+        header->len = sizeof(h);
+    } else if (rank == 0) {
+        if (columns == RESULTS_POINTS) {
+            for (int d = 0; d < num_values; d++)
+                text_append(header, "x%d,", d + 1);
+        }
+        text_append(header, "label");
+        if (columns == RESULTS_RESP) {
+            text_append(header, ",log_density");
+            for (int k = 1; k < num_values; k++)
+                text_append(header, ",p%d", k);
+        }
+        text_append(header, "\n");
+    }
+
+#ifdef USE_MPI
+    if (open_results_mpi(path, &w->fh) != 0) {
+        results_close(w);
+        return -1;
+    }
+    w->offset = write_blocks_mpi(w->fh, 0, header, 1);
+    if (w->offset < 0) {
+        if (rank == 0) fprintf(stderr, "%s: write failed\n", path);
+        results_close(w);
+        return -1;
+    }
+#else
+    w->fp = fopen(path, "wb");
+    if (!w->fp || fwrite(header->data, 1, header->len, w->fp) != header->len) {
+        perror(path);
+        results_close(w);
+        return -1;
+    }
+    w->offset = (long long)header->len;
+#endif
+    return 0;
+}
+
+int results_write(ResultsWriter *w, const ResultRows *rows, int num_rows) {
+    int num_blocks = (num_rows + RESULTS_BLOCK_ROWS - 1) / RESULTS_BLOCK_ROWS;
+#ifdef USE_MPI
+    // all the rows of the process at once: one collective, every block
+    // written at its own offset
+    ensure_blocks(w, num_blocks);
+    format_blocks(w, rows, 0, num_rows, num_blocks);
+    long long written = write_blocks_mpi(w->fh, w->offset, w->blocks, num_blocks);
+    if (written < 0) return -1;
+    w->offset += written;
+#else
+    // a batch of blocks (one per thread) formatted in parallel, then written in order
+    for (int first = 0; first < num_blocks; first += w->num_blocks) {
+        int batch = (num_blocks - first < w->num_blocks) ? num_blocks - first : w->num_blocks;
+        format_blocks(w, rows, first * RESULTS_BLOCK_ROWS, num_rows, batch);
+        for (int j = 0; j < batch; j++) {
+            if (fwrite(w->blocks[j].data, 1, w->blocks[j].len, w->fp) != w->blocks[j].len) return -1;
+            w->offset += (long long)w->blocks[j].len;
+        }
+    }
+#endif
+    return 0;
+}
+
+int results_close(ResultsWriter *w) {
+    int ret = 0;
+#ifdef USE_MPI
+    if (w->fh != MPI_FILE_NULL) MPI_File_close(&w->fh);
+#else
+    if (w->fp && fclose(w->fp) != 0) ret = -1;
+    w->fp = NULL;
+#endif
+    for (int j = 0; j < w->num_blocks; j++)
+        free(w->blocks[j].data);
+    free(w->blocks);
+    w->blocks = NULL;
+    w->num_blocks = 0;
+    return ret;
+}
+
+// Rows of points scored with 'gmm': the labels are the caller's unless the
+// format has the responsibilities, which (with the labels that go with
+// them) come from one scoring pass. Scratch set up and 'gmm' precomputed.
+int results_write_points(ResultsWriter *w, T *data, int num_points, GMM *gmm, int *labels) {
+    ResultRows rows = { data, NULL, NULL, labels };
+    T *resp = NULL, *log_density = NULL;
+    if (w->columns == RESULTS_RESP) {
+        resp = (T*)malloc(((size_t)num_points * gmm->num_clusters + 1) * sizeof(T));
+        log_density = (T*)malloc(((size_t)num_points + 1) * sizeof(T));
+        score_points(data, num_points, gmm, resp, log_density, labels);
+        rows.resp = resp;
+        rows.log_density = log_density;
+    }
+    int ret = results_write(w, &rows, num_points);
+    free(resp);
+    free(log_density);
+    return ret;
+}
+
+int results_num_values(int columns, const GMM *gmm) {
+    return columns == RESULTS_POINTS ? gmm->dim : columns == RESULTS_RESP ? gmm->num_clusters + 1 : 0;
+}
+
+// Result file of a fit, in the format of --output-format (csv by default).
+// Collective under MPI, 'data' and 'labels' being the local points.
+int write_results(const char *path, const EMOptions *options, T *data, int *labels, GMM *gmm, int num_points) {
+    int columns = options->output_columns == RESULTS_DEFAULT ? RESULTS_POINTS : options->output_columns;
+    ResultsWriter w;
+    if (results_open(&w, path, columns, options->output_binary, results_num_values(columns, gmm)) != 0) return -1;
+
+    if (columns == RESULTS_RESP) {
+        scratch_setup(SCRATCH_BYTES(PDF_SCRATCH_ELEMS(gmm->dim, gmm->num_clusters), sizeof(T), PDF_SCRATCH_ALLOCS));
+        precompute_gaussians(gmm, gmm->num_clusters, gmm->dim);
+    }
+    int ret = results_write_points(&w, data, num_points, gmm, labels);
+    if (columns == RESULTS_RESP) scratch_teardown();
+
+    if (results_close(&w) != 0) ret = -1;
+    if (ret != 0) fprintf(stderr, "%s: write failed\n", path);
+    return ret;
+}
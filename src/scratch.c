@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "include/scratch.h"
+
+// One set of arenas per team of threads: the whole process, or each of the
+// teams running --n-init restarts side by side (see scratch_teams)
+typedef struct {
+    Scratch *arenas;
+    int num_arenas;
+} ArenaSet;
+
+static ArenaSet process_set = {NULL, 0};
+static ArenaSet *sets = &process_set;
+
+#ifdef _OPENMP
+static int team_level = 0; // Nesting level of the teams' master threads, 0 without teams
+
+static ArenaSet* team_set(void) {
+    return team_level ? &sets[omp_get_ancestor_thread_num(team_level)] : sets;
+}
+
+void scratch_teams(int num_teams) {
+    if (num_teams > 0) {
+        sets = (ArenaSet*)calloc(num_teams, sizeof(ArenaSet));
+        team_level = omp_get_level() + 1;
+    } else {
+        free(sets);
+        sets = &process_set;
+        team_level = 0;
+    }
+}
+#else
+static ArenaSet* team_set(void) {
+    return sets;
+}
+#endif
+
+// Allocate one arena per thread of the team (one in the sequential and MPI builds)
+void scratch_setup(size_t bytes_per_thread) {
+    scratch_teardown();
+    ArenaSet *set = team_set();
+
+#ifdef _OPENMP
+    set->num_arenas = omp_get_max_threads();
+#else
+    set->num_arenas = 1;
+#endif
+    bytes_per_thread = (bytes_per_thread + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN;
+    Scratch *arenas = (Scratch*)malloc(set->num_arenas * sizeof(Scratch));
+    set->arenas = arenas;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1)
+#endif
+    for (int t = 0; t < set->num_arenas; t++) {
+        // first touch by the owning thread
+        if (posix_memalign((void**)&arenas[t].base, SCRATCH_ALIGN, bytes_per_thread) != 0) {
+            fprintf(stderr, "Scratch arena allocation failed (%zu bytes)\n", bytes_per_thread);
+            exit(1);
+        }
+        memset(arenas[t].base, 0, bytes_per_thread);
+        arenas[t].size = bytes_per_thread;
+        arenas[t].used = 0;
+    }
+}
+
+void scratch_teardown(void) {
+    ArenaSet *set = team_set();
+    for (int t = 0; t < set->num_arenas; t++)
+        free(set->arenas[t].base);
+    free(set->arenas);
+    set->arenas = NULL;
+    set->num_arenas = 0;
+}
+
+Scratch* thread_scratch(void) {
+#ifdef _OPENMP
+    // thread number within the team: at the level below the teams' masters
+    int level = omp_get_level();
+    return &team_set()->arenas[level > team_level ? omp_get_ancestor_thread_num(team_level + 1) : 0];
+#else
+    return &sets->arenas[0];
+#endif
+}
+
+void* scratch_alloc(Scratch *s, size_t bytes) {
+    size_t offset = (s->used + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN;
+    if (offset + bytes > s->size) {
+        fprintf(stderr, "Scratch arena exhausted (%zu of %zu bytes requested)\n", offset + bytes, s->size);
+        exit(1);
+    }
+    s->used = offset + bytes;
+    return s->base + offset;
+}
+
+void* scratch_calloc(Scratch *s, size_t bytes) {
+    void *p = scratch_alloc(s, bytes);
+    memset(p, 0, bytes);
+    return p;
+}
+
+#ifdef DEBUG_ALLOC
+/*
+   Allocation counter: debug builds link with -Wl,--wrap=malloc,calloc,realloc
+   so every heap allocation made by our own code goes through these wrappers
+   (calls from inside shared libraries such as MPI are not counted)
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static long allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+long alloc_count(void) {
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+#endif
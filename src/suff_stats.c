@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/commons.h"
+#include "include/suff_stats.h"
+
+#define COV_REG 1e-6 // Added to the covariance diagonals
+
+// Lay out the three statistics arrays over 'buffer' (STATS_ELEMS doubles)
+void stats_init(SuffStats *stats, int num_clusters, int dim, double *buffer) {
+    stats->num_clusters = num_clusters;
+    stats->dim = dim;
+    stats->size = STATS_ELEMS(num_clusters, dim);
+    stats->data = buffer;
+    stats->resp_sum = buffer;
+    stats->x_sum = buffer + num_clusters;
+    stats->xx_sum = buffer + num_clusters * (1 + dim);
+    stats->log_lik = buffer + stats->size - 1;
+}
+
+void stats_init_scratch(SuffStats *stats, int num_clusters, int dim, Scratch *scratch) {
+    double *buffer = (double*)scratch_alloc(scratch, STATS_ELEMS(num_clusters, dim) * sizeof(double));
+    stats_init(stats, num_clusters, dim, buffer);
+}
+
+void stats_zero(SuffStats *stats) {
+    memset(stats->data, 0, stats->size * sizeof(double));
+}
+
+// Add one point with its responsibilities to the statistics of all components.
+// The diagonal covariance models only need the diagonal of xx_sum, O(dim)
+// instead of O(dim^2) per point and component (the rest stays zero).
+void stats_accumulate(SuffStats *stats, const T *x, const T *resp_row, GMM *gmm) {
+    int dim = stats->dim;
+    int packed = PACKED_SIZE(dim);
+    int diagonal = gmm->cov_type == COV_DIAG || gmm->cov_type == COV_SPHERICAL;
+
+    for (int k = 0; k < stats->num_clusters; k++) {
+        double r = resp_row[k];
+        if (r == 0.0) continue;
+
+        const T *shift = gmm_mean(gmm, k);
+        double *x_sum = stats->x_sum + k * dim;
+        double *xx_sum = stats->xx_sum + k * packed;
+
+        stats->resp_sum[k] += r;
+        if (diagonal) {
+            // (i, i) of the packed triangle is at i * dim - i * (i - 1) / 2
+            for (int i = 0, idx = 0; i < dim; idx += dim - i, i++) {
+                double diff = x[i] - shift[i];
+                x_sum[i] += r * diff;
+                xx_sum[idx] += r * diff * diff;
+            }
+            continue;
+        }
+        int idx = 0;
+        for (int i = 0; i < dim; i++) {
+            double r_diff_i = r * (x[i] - shift[i]);
+            x_sum[i] += r_diff_i;
+            for (int j = i; j < dim; j++) {
+                xx_sum[idx++] += r_diff_i * (x[j] - shift[j]);
+            }
+        }
+    }
+}
+
+// Streaming E-step on a block of 'count' <= POINT_BLOCK consecutive points:
+// responsibilities are computed in a small tile and folded straight into
+// the statistics, the log-likelihood of the block is added to *log_lik
+void stats_accumulate_block(SuffStats *stats, const T *x, int count, GMM *gmm) {
+    int dim = stats->dim;
+    int num_clusters = stats->num_clusters;
+    Scratch *scratch = thread_scratch();
+    size_t mark = scratch_mark(scratch);
+    T *resp = (T*)scratch_alloc(scratch, POINT_BLOCK * num_clusters * sizeof(T));
+
+    log_joint_block(x, count, dim, gmm, num_clusters, resp);
+    for (int p = 0; p < count; p++) {
+        T *resp_row = &resp[p * num_clusters];
+        *stats->log_lik += log_sum_exp_normalize(resp_row, num_clusters);
+        stats_accumulate(stats, &x[p * dim], resp_row, gmm);
+    }
+    scratch_release(scratch, mark);
+}
+
+void stats_add(SuffStats *dst, const SuffStats *src) {
+    for (size_t i = 0; i < dst->size; i++)
+        dst->data[i] += src->data[i];
+}
+
+// Weights, means and covariances from the statistics:
+//   mean_k = c_k + x_sum_k / N_k
+//   cov_k  = xx_sum_k / N_k - (mean_k - c_k)(mean_k - c_k)^T
+// projected onto the covariance model of the GMM (constrain_covariances).
+// 'gmm' must still hold the shifts c_k (the means the statistics were taken with)
+void stats_to_gmm(const SuffStats *stats, GMM *gmm, double total_resp) {
+    int dim = stats->dim;
+    int packed = PACKED_SIZE(dim);
+
+    for (int k = 0; k < stats->num_clusters; k++) {
+        double resp_sum = stats->resp_sum[k];
+        double inv_resp = 1.0 / (resp_sum + 1e-18);
+        const double *x_sum = stats->x_sum + k * dim;
+        const double *xx_sum = stats->xx_sum + k * packed;
+        T *mean = gmm_mean(gmm, k);
+        T *cov = gmm_cov(gmm, k);
+
+        gmm->class_resp[k] = resp_sum;
+        gmm->weights[k] = resp_sum / total_resp;
+
+        int idx = 0;
+        for (int i = 0; i < dim; i++) {
+            double delta_i = x_sum[i] * inv_resp;
+            for (int j = i; j < dim; j++) {
+                double delta_j = x_sum[j] * inv_resp;
+                double val = xx_sum[idx++] * inv_resp - delta_i * delta_j;
+                cov[i * dim + j] = val;
+                cov[j * dim + i] = val; // Symmetry
+            }
+            cov[i * dim + i] += COV_REG; // Regularization
+        }
+        for (int i = 0; i < dim; i++)
+            mean[i] += x_sum[i] * inv_resp;
+    }
+    constrain_covariances(gmm);
+}
+
+// Stepwise (online) EM update from the statistics of a mini-batch. The
+// current parameters stand for normalized running statistics, about the
+// shifts c_k = mean_k:
+//   s0_k = weight_k,  s1_k = 0,  s2_k = weight_k (cov_k - reg I)
+// the batch ones are divided by the batch size B = sum_k resp_sum_k and
+// blended in with weight 'step' in (0, 1]:
+//   s <- (1 - step) s + step batch / B
+// then mean_k, cov_k and weight_k = s0_k follow as in stats_to_gmm. With
+// step 1 and the whole dataset as the batch this is stats_to_gmm.
+void stats_step_gmm(const SuffStats *batch, GMM *gmm, double step) {
+    int dim = batch->dim;
+    int packed = PACKED_SIZE(dim);
+
+    double batch_size = 0.0;
+    for (int k = 0; k < batch->num_clusters; k++)
+        batch_size += batch->resp_sum[k];
+    double batch_scale = step / batch_size;
+
+    for (int k = 0; k < batch->num_clusters; k++) {
+        const double *x_sum = batch->x_sum + k * dim;
+        const double *xx_sum = batch->xx_sum + k * packed;
+        T *mean = gmm_mean(gmm, k);
+        T *cov = gmm_cov(gmm, k);
+
+        double keep = (1.0 - step) * gmm->weights[k];
+        double s0 = keep + batch_scale * batch->resp_sum[k];
+        double inv_s0 = 1.0 / (s0 + 1e-18);
+
+        gmm->class_resp[k] = batch->resp_sum[k];
+        gmm->weights[k] = s0;
+
+        int idx = 0;
+        for (int i = 0; i < dim; i++) {
+            double delta_i = batch_scale * x_sum[i] * inv_s0;
+            for (int j = i; j < dim; j++) {
+                double delta_j = batch_scale * x_sum[j] * inv_s0;
+                double s2 = keep * (cov[i * dim + j] - (i == j ? COV_REG : 0.0)) + batch_scale * xx_sum[idx++];
+                double val = s2 * inv_s0 - delta_i * delta_j;
+                cov[i * dim + j] = val;
+                cov[j * dim + i] = val; // Symmetry
+            }
+            cov[i * dim + i] += COV_REG; // Regularization
+        }
+        for (int i = 0; i < dim; i++)
+            mean[i] += batch_scale * x_sum[i] * inv_s0;
+    }
+    constrain_covariances(gmm);
+}
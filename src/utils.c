@@ -3,199 +3,188 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
-#include "include/matrix_utils.h"
+#include <stdarg.h>
 #include "include/utils.h"
 #include "include/commons.h"
+#include "include/model.h"
+#include "include/results.h"
+#include "include/init.h"
+#include "include/model_selection.h"
 
-void parsing(int argc, char *argv[], int *num_clusters, char *dataset_path, char *output_path) {
+void parsing(int argc, char *argv[], int *num_clusters, char *dataset_path, char *output_path, EMOptions *options) {
     *num_clusters = DEFAULT_NUM_CLUSTERS;
+    options->streaming = 0;
+    options->seed = (unsigned int)time(NULL);
+    options->convert_path[0] = '\0';
+    options->weights[0] = '\0';
+    options->affinity = 0;
+    options->online = 0;
+    options->epochs = 1;
+    options->lr_decay = 0.6;
+    options->lr_offset = 2.0;
+    options->checkpoint_path[0] = '\0';
+    options->checkpoint_every = DEFAULT_CHECKPOINT_EVERY;
+    options->resume_path[0] = '\0';
+    options->init_model[0] = '\0';
+    options->save_model[0] = '\0';
+    options->predict_model[0] = '\0';
+    options->output_columns = RESULTS_DEFAULT;
+    options->output_binary = 0;
+    options->init_method = INIT_FARTHEST;
+    options->kmeans_iters = 0;
+    options->n_init = 1;
+    options->cov_type = COV_FULL;
+    options->k_max = 0;
+    options->criterion = CRITERION_BIC;
+    options->start_iter = 0;
+    options->start_log_lik = -INFINITY;
+    options->max_iter = MAX_ITER;
     strcpy(dataset_path, DEFAULT_DATASET_PATH);
     strcpy(output_path, DEFAULT_OUTPUT_PATH);
     
     if (argc < 2) {
         printf("\nNo arguments provided. Using default values.\n");
-        printf("Usage: ./em_clustering [-d <dataset_path>] [-k <num_clusters>] [-o <output_path>]\n\n");
+        printf("Usage: ./em_clustering [-d <dataset_path>] [-k <num_clusters> | -k <min>:<max> [--criterion bic|aic]] [-o <output_path>] [-s] [--seed <n>] [--init farthest|kmeans++|kmeans-par] [--kmeans <iters>] [--n-init <n>] [--covariance full|diag|spherical|tied] [-c <binary_path>] [--weights <w0,w1,...>] [--affinity report|pin] [--online <points> [--epochs <n>] [--lr-decay <a>] [--lr-offset <t0>]] [--checkpoint <path> [--checkpoint-every <n>]] [--resume <path> | --init-model <path>] [--save-model <path>] [--predict <model>] [--output-format <fmt>]\n\n");
     }
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
             strcpy(dataset_path, argv[++i]);
         } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
-            *num_clusters = atoi(argv[++i]);
+            const char *range = strchr(argv[++i], ':');
+            *num_clusters = atoi(argv[i]);
+            options->k_max = range ? atoi(range + 1) : 0;
+        } else if (strcmp(argv[i], "--criterion") == 0 && i + 1 < argc
+                   && (strcmp(argv[i + 1], "bic") == 0 || strcmp(argv[i + 1], "aic") == 0)) {
+            options->criterion = strcmp(argv[++i], "aic") == 0 ? CRITERION_AIC : CRITERION_BIC;
         } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             strcpy(output_path, argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            options->streaming = 1;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            strcpy(options->convert_path, argv[++i]);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            strcpy(options->weights, argv[++i]);
+        } else if (strcmp(argv[i], "--affinity") == 0 && i + 1 < argc
+                   && (strcmp(argv[i + 1], "report") == 0 || strcmp(argv[i + 1], "pin") == 0)) {
+            options->affinity = strcmp(argv[++i], "pin") == 0 ? AFFINITY_PIN : AFFINITY_REPORT;
+        } else if (strcmp(argv[i], "--online") == 0 && i + 1 < argc) {
+            options->online = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc) {
+            options->epochs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lr-decay") == 0 && i + 1 < argc) {
+            options->lr_decay = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--lr-offset") == 0 && i + 1 < argc) {
+            options->lr_offset = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            strcpy(options->checkpoint_path, argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            options->checkpoint_every = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            strcpy(options->resume_path, argv[++i]);
+        } else if (strcmp(argv[i], "--init-model") == 0 && i + 1 < argc) {
+            strcpy(options->init_model, argv[++i]);
+        } else if (strcmp(argv[i], "--save-model") == 0 && i + 1 < argc) {
+            strcpy(options->save_model, argv[++i]);
+        } else if (strcmp(argv[i], "--predict") == 0 && i + 1 < argc) {
+            strcpy(options->predict_model, argv[++i]);
+        } else if (strcmp(argv[i], "--output-format") == 0 && i + 1 < argc
+                   && parse_output_format(argv[i + 1], &options->output_columns, &options->output_binary) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--init") == 0 && i + 1 < argc
+                   && parse_init_method(argv[i + 1], &options->init_method) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--kmeans") == 0 && i + 1 < argc) {
+            options->kmeans_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--covariance") == 0 && i + 1 < argc
+                   && parse_cov_type(argv[i + 1], &options->cov_type) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--n-init") == 0 && i + 1 < argc) {
+            options->n_init = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
         } else {
             printf("Unknown argument: %s\n", argv[i]);
-            printf("Usage: ./%s [-d <dataset_path>] [-k <num_clusters>] [-o <output_path>]\n", argv[0]);
+            printf("Usage: ./%s [-d <dataset_path>] [-k <num_clusters> | -k <min>:<max> [--criterion bic|aic]] [-o <output_path>] [-s] [--seed <n>] [--init farthest|kmeans++|kmeans-par] [--kmeans <iters>] [--n-init <n>] [--covariance full|diag|spherical|tied] [-c <binary_path>] [--weights <w0,w1,...>] [--affinity report|pin] [--online <points> [--epochs <n>] [--lr-decay <a>] [--lr-offset <t0>]] [--checkpoint <path> [--checkpoint-every <n>]] [--resume <path> | --init-model <path>] [--save-model <path>] [--predict <model>] [--output-format <fmt>]\n", argv[0]);
             exit(1);
         }
     }
-}
 
-T* load_csv(const char* filename, int* num_rows, int* num_cols) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        perror("fopen");
-        return NULL;
+    if (options->kmeans_iters < 0) {
+        printf("Invalid --kmeans: iterations >= 0\n");
+        exit(1);
     }
 
-    char line[4096]; // Aumentato per sicurezza con D grandi
-
-    /* ---- 1. Leggi header: conta le colonne ---- */
-    if (!fgets(line, sizeof(line), file)) {
-        fclose(file);
-        return NULL;
+    // the sweep fits every K from scratch, on the whole dataset
+    if (options->k_max == *num_clusters) options->k_max = 0;
+    if (options->k_max && (*num_clusters < 1 || options->k_max < *num_clusters || options->online
+                           || options->resume_path[0] || options->init_model[0] || options->checkpoint_path[0])) {
+        printf("Invalid -k <min>:<max>: 1 <= min <= max, and not with --online, --resume, --init-model or --checkpoint\n");
+        exit(1);
     }
 
-    *num_cols = 0;
-    char* line_copy = strdup(line); // Copia per non rovinare l'originale
-    char* token = strtok(line_copy, ",\n");
-    while (token) {
-        if (strcmp(token, "label") == 0) break;
-        (*num_cols)++;
-        token = strtok(NULL, ",\n");
+    // every restart starts from its own initialization
+    if (options->n_init < 1 || (options->n_init > 1 && (options->online || options->resume_path[0]
+                                || options->init_model[0] || options->checkpoint_path[0]))) {
+        printf("Invalid --n-init: >= 1, and not with --online, --resume, --init-model or --checkpoint\n");
+        exit(1);
     }
-    free(line_copy);
 
-    /* ---- 2. Conta le righe ---- */
-    *num_rows = 0;
-    while (fgets(line, sizeof(line), file)) {
-        (*num_rows)++;
+    if (options->checkpoint_every < 1 || (options->resume_path[0] && options->init_model[0])) {
+        printf("Invalid model options: --checkpoint-every >= 1, only one of --resume and --init-model\n");
+        exit(1);
     }
 
-    /* ---- 3. Alloca array 1D piatto ---- */
-    // Un'unica malloc per tutto il dataset
-    T* data = (T*)malloc((*num_rows) * (*num_cols) * sizeof(T));
-    if (!data) {
-        fclose(file);
-        return NULL;
+    // mini-batches of a few rows could leave a CSV chunk (a byte range) empty;
+    // the step sizes must sum to infinity and their squares must not: 0.5 < a <= 1,
+    // and t0 >= 1 keeps every step in (0, 1]
+    if (options->online < 0 || (options->online > 0 && (options->online < 64 || options->epochs < 1 || options->lr_offset < 1.0
+                                || options->lr_decay <= 0.5 || options->lr_decay > 1.0))) {
+        printf("Invalid online EM settings: --online <points> >= 64, --epochs >= 1, 0.5 < --lr-decay <= 1, --lr-offset >= 1\n");
+        exit(1);
     }
 
-    /* ---- 4. Leggi i dati ---- */
-    rewind(file);
-    fgets(line, sizeof(line), file); // Salta header
-
-    for (int i = 0; i < *num_rows; i++) {
-        if (!fgets(line, sizeof(line), file)) break;
-
-        token = strtok(line, ",\n");
-        for (int j = 0; j < *num_cols && token; j++) {
-            // Calcolo dell'indice lineare: riga * larghezza + colonna
-            data[i * (*num_cols) + j] = (T)atof(token);
-            token = strtok(NULL, ",\n");
-        }
+    // the online EM has no checkpoint of its own (step count, shuffle, epoch):
+    // refuse rather than silently start over on a resubmitted job
+    if (options->online && (options->checkpoint_path[0] || options->resume_path[0] || options->init_model[0])) {
+        printf("Invalid --online: not with --checkpoint, --resume or --init-model\n");
+        exit(1);
     }
-
-    fclose(file);
-    return data;
 }
 
-void write_results_csv(const char *filename, T *data, int *labels, int N, int dim) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) {
-        perror("fopen");
-        return;
-    }
-
-    /* ---- 1. Scrittura Header ---- */
-    for (int d = 0; d < dim; d++) {
-        fprintf(fp, "x%d,", d + 1);
-    }
-    fprintf(fp, "label\n");
-
-    /* ---- 2. Scrittura Dati + Labels ---- */
-    for (int i = 0; i < N; i++) {
-        int row_offset = i * dim; // Calcolo dell'offset della riga
-        
-        for (int d = 0; d < dim; d++) {
-            // Accesso lineare al dataset piatto
-            fprintf(fp, "%.6f,", data[row_offset + d]);
+// printf at the end of the buffer, which grows as needed
+void text_append(TextBuffer *b, const char *fmt, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, args);
+        va_end(args);
+        if (n >= 0 && (size_t)n < b->cap - b->len) {
+            b->len += n;
+            return;
         }
-        
-        // labels è già un array 1D di dimensione N, quindi rimane invariato
-        fprintf(fp, "%d\n", labels[i] + 1);
+        b->cap = 2 * b->cap + 64;
+        b->data = (char*)realloc(b->data, b->cap);
     }
-
-    fclose(fp);
 }
 
-void init_gmm(Gaussian *gmm, int K, int dim, T *data, int N) {
-    // Per test di performance confrontabili, potresti voler usare un seed fisso:
-    // srand(42); 
-    srand(time(NULL));
+// Makes room for 'bytes' more bytes, for writers that fill the buffer directly
+void text_reserve(TextBuffer *b, size_t bytes) {
+    if (b->cap - b->len >= bytes) return;
+    while (b->cap - b->len < bytes)
+        b->cap = 2 * b->cap + 64;
+    b->data = (char*)realloc(b->data, b->cap);
+}
 
-    // 1. Prima media: punto casuale
-    int idx = rand() % N;
+void print_cluster_params(GMM *gmm) {
+    int K = gmm->num_clusters, dim = gmm->dim;
+    printf("\nCluster Parameters:\n");
+    printf("%-7s | %-8s | %s\n", "Cluster", "Weight", "Mean");
+    printf("%s\n", "--------+----------+-----------------------------");
     for (int k = 0; k < K; k++) {
-        gmm[k].mean = (T*)malloc(dim * sizeof(T));
-    }
-    
-    // Copia il primo punto scelto casualmente
-    for (int d = 0; d < dim; d++) {
-        gmm[0].mean[d] = data[idx * dim + d];
-    }
-
-    // 2. Medie successive: K-means++ style (punti lontani)
-    for (int k = 1; k < K; k++) {
-        T max_dist = -1.0;
-        int best_idx = 0;
-
-        for (int n = 0; n < N; n++) {
-            T min_dist = INFINITY;
-            for (int j = 0; j < k; j++) {
-                T dist = 0.0;
-                for (int d = 0; d < dim; d++) {
-                    // Accesso 1D: n * dim + d
-                    T diff = data[n * dim + d] - gmm[j].mean[d];
-                    dist += diff * diff;
-                }
-                if (dist < min_dist) min_dist = dist;
-            }
-            if (min_dist > max_dist) {
-                max_dist = min_dist;
-                best_idx = n;
-            }
-        }
-
+        printf("%-7d | %-8.3f | [", k, gmm->weights[k]);
         for (int d = 0; d < dim; d++) {
-            gmm[k].mean[d] = data[best_idx * dim + d];
+            printf("%.3f%s", gmm_mean(gmm, k)[d], d < dim-1 ? ", " : "");
         }
+        printf("]\n");
     }
-
-    // 3. Calcolo Covarianza Globale iniziale
-    T** global_cov = alloc_matrix(dim, dim);
-    T* data_mean = (T*)calloc(dim, sizeof(T));
-
-    // Media globale dei dati
-    for (int n = 0; n < N; n++) {
-        for (int d = 0; d < dim; d++) {
-            data_mean[d] += data[n * dim + d];
-        }
-    }
-    for (int d = 0; d < dim; d++) data_mean[d] /= N;
-
-    // Covarianza globale
-    for (int i = 0; i < dim; i++) {
-        for (int j = 0; j < dim; j++) {
-            T cov_ij = 0.0;
-            for (int n = 0; n < N; n++) {
-                cov_ij += (data[n * dim + i] - data_mean[i]) * (data[n * dim + j] - data_mean[j]);
-            }
-            global_cov[i][j] = cov_ij / N;
-        }
-    }
-
-    // 4. Assegnazione ai cluster
-    for (int k = 0; k < K; k++) {
-        gmm[k].weight = 1.0 / K;
-        gmm[k].cov = alloc_matrix(dim, dim);
-        gmm[k].class_resp = 0.0;
-        for (int i = 0; i < dim; i++) {
-            for (int j = 0; j < dim; j++) {
-                gmm[k].cov[i][j] = global_cov[i][j];
-            }
-        }
-    }
-
-    free(data_mean);
-    free_matrix(global_cov, dim);
-}
\ No newline at end of file
+}